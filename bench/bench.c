@@ -0,0 +1,229 @@
+/*
+ * Copyright 2018-2023 Michael Santos <michael.santos@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures cron_parse_expr, cron_next, cron_prev, cron_iter_next,
+ * cron_match, cron_match_batch, cron_count and cron_table_next over a
+ * corpus of expressions. Output is tab separated:
+ *
+ *   build  libc  op  ns/op  allocs/op  expression
+ *
+ * Build with -DCRON_TEST_MALLOC to count allocations.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ccronexpr.h"
+
+#ifdef CRON_USE_LOCAL_TIME
+#define BENCH_BUILD "local"
+#else
+#define BENCH_BUILD "utc"
+#endif
+
+#if defined(__GLIBC__)
+#define BENCH_LIBC "glibc"
+#elif defined(__linux__)
+#define BENCH_LIBC "musl"
+#else
+#define BENCH_LIBC "libc"
+#endif
+
+/* start times around daylight saving time changes and leap days */
+static const time_t timestamps[] = {
+    1520751300, /* 2018-03-11 06:55:00 UTC: US clocks go forward */
+    1541310900, /* 2018-11-04 05:55:00 UTC: US clocks go back */
+    1521939300, /* 2018-03-25 00:55:00 UTC: EU clocks go forward */
+    1540688100, /* 2018-10-28 00:55:00 UTC: EU clocks go back */
+    1582934400, /* 2020-02-29 00:00:00 UTC */
+    1609459199, /* 2020-12-31 23:59:59 UTC */
+    1234567890, /* 2009-02-13 23:31:30 UTC */
+    1700000000, /* 2023-11-14 22:13:20 UTC */
+};
+
+#define NTIMESTAMPS (sizeof(timestamps) / sizeof(timestamps[0]))
+
+/* runs enumerated by iter from each timestamp */
+#define NSTEPS 64
+
+/* dates checked by match: every 3 seconds around the US change */
+#define NDATES 4096
+static time_t dates[NDATES];
+static uint64_t matched[NDATES / 64];
+
+static unsigned long long allocs;
+static volatile time_t sink;
+
+#ifdef CRON_TEST_MALLOC
+void *cron_malloc(size_t n) {
+  allocs++;
+  return malloc(n);
+}
+
+void cron_free(void *p) { free(p); }
+#endif
+
+static unsigned long long nsec(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    err(EXIT_FAILURE, "error: clock_gettime");
+
+  return (unsigned long long)ts.tv_sec * 1000000000ULL +
+         (unsigned long long)ts.tv_nsec;
+}
+
+static void report(const char *op, const char *s, unsigned long long start,
+                   unsigned long long ops) {
+  unsigned long long elapsed = nsec() - start;
+
+  (void)printf("%s\t%s\t%s\t%.1f\t%.2f\t%s\n", BENCH_BUILD, BENCH_LIBC, op,
+               (double)elapsed / (double)ops, (double)allocs / (double)ops,
+               s);
+}
+
+static void bench(const char *s, unsigned long long iterations) {
+  cron_expr expr;
+  cron_iter iter;
+  cron_table table;
+  const char *errbuf = NULL;
+  unsigned long long start;
+  unsigned long long i;
+  size_t j;
+  size_t k;
+
+  cron_parse_expr(s, &expr, &errbuf);
+  if (errbuf)
+    errx(EXIT_FAILURE, "error: %s: %s", s, errbuf);
+
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++) {
+    cron_parse_expr(s, &expr, &errbuf);
+    sink = (time_t)expr.seconds[0];
+  }
+  report("parse", s, start, iterations);
+
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < NTIMESTAMPS; j++)
+      sink = cron_next(&expr, timestamps[j]);
+  report("next", s, start, iterations * NTIMESTAMPS);
+
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < NTIMESTAMPS; j++)
+      sink = cron_prev(&expr, timestamps[j]);
+  report("prev", s, start, iterations * NTIMESTAMPS);
+
+  /* enumerating the runs after each start time */
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < NTIMESTAMPS; j++) {
+      cron_iter_init(&iter, &expr, timestamps[j]);
+      for (k = 0; k < NSTEPS; k++)
+        sink = cron_iter_next(&iter);
+    }
+  report("iter", s, start, iterations * NTIMESTAMPS * NSTEPS);
+
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < NDATES; j++)
+      sink = cron_match(&expr, dates[j]);
+  report("match", s, start, iterations * NDATES);
+
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++)
+    sink = (time_t)cron_match_batch(&expr, dates, NDATES, matched);
+  report("match_batch", s, start, iterations * NDATES);
+
+  /* runs in the 5 years after each start time */
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < NTIMESTAMPS; j++)
+      sink = (time_t)cron_count(&expr, timestamps[j],
+                                timestamps[j] + 5 * 365 * 86400);
+  report("count", s, start, iterations * NTIMESTAMPS);
+
+  /* next runs after the match dates from a table of the runs after them */
+  if (cron_table_build(&table, &expr, dates[0], dates[NDATES - 1] + 86400) != 0)
+    errx(EXIT_FAILURE, "error: cron_table_build");
+
+  allocs = 0;
+  start = nsec();
+  for (i = 0; i < iterations; i++)
+    for (j = 0; j < NDATES; j++)
+      sink = cron_table_next(&table, dates[j]);
+  report("table_next", s, start, iterations * NDATES);
+
+  cron_table_free(&table);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long long iterations = 1000;
+  char line[256];
+  FILE *fp;
+  char *p;
+  size_t i;
+
+  if (argc < 2 || argc > 3) {
+    (void)fprintf(stderr, "usage: %s <corpus> [<iterations>]\n", argv[0]);
+    exit(2);
+  }
+
+  if (argc == 3) {
+    iterations = strtoull(argv[2], &p, 10);
+    if (*p != '\0' || iterations == 0)
+      errx(2, "error: invalid iterations: %s", argv[2]);
+  }
+
+  fp = fopen(argv[1], "r");
+  if (fp == NULL)
+    err(EXIT_FAILURE, "error: %s", argv[1]);
+
+  for (i = 0; i < NDATES; i++)
+    dates[i] = timestamps[0] - NDATES / 2 * 3 + (time_t)i * 3;
+
+  /* load the time zone outside of the measurements */
+  (void)cron_tz_init(NULL);
+
+  (void)printf("build\tlibc\top\tns/op\tallocs/op\texpression\n");
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#')
+      continue;
+
+    bench(line, iterations);
+  }
+
+  if (ferror(fp))
+    err(EXIT_FAILURE, "error: %s", argv[1]);
+
+  (void)fclose(fp);
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2018-2023 Michael Santos <michael.santos@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures cron_histogram over 10k and 100k expressions for a window of
+ * 30 days in second, minute and hour buckets. Output is tab separated:
+ *
+ *   build  libc  entries  bucket  buckets  runs  ms
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ccronexpr.h"
+
+#ifdef CRON_USE_LOCAL_TIME
+#define BENCH_BUILD "local"
+#else
+#define BENCH_BUILD "utc"
+#endif
+
+#if defined(__GLIBC__)
+#define BENCH_LIBC "glibc"
+#elif defined(__linux__)
+#define BENCH_LIBC "musl"
+#else
+#define BENCH_LIBC "libc"
+#endif
+
+/* 2018-03-01 00:00:00 UTC: the window includes the US change */
+#define WINDOW_START 1519862400
+#define WINDOW_DAYS 30
+
+#ifdef CRON_TEST_MALLOC
+void *cron_malloc(size_t n) { return malloc(n); }
+
+void cron_free(void *p) { free(p); }
+#endif
+
+static unsigned long long nsec(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    err(EXIT_FAILURE, "error: clock_gettime");
+
+  return (unsigned long long)ts.tv_sec * 1000000000ULL +
+         (unsigned long long)ts.tv_nsec;
+}
+
+/* a mix of schedules from every few seconds to daily */
+static void expression(char *buf, size_t len) {
+  switch (rand() % 5) {
+  case 0:
+    (void)snprintf(buf, len, "%d */%d * * * *", rand() % 60, 1 + rand() % 30);
+    break;
+  case 1:
+    (void)snprintf(buf, len, "*/%d * * * * *", 5 + rand() % 55);
+    break;
+  case 2:
+    (void)snprintf(buf, len, "%d %d * * * *", rand() % 60, rand() % 60);
+    break;
+  case 3:
+    (void)snprintf(buf, len, "0 %d %d * * 1-5", rand() % 60, rand() % 24);
+    break;
+  default:
+    (void)snprintf(buf, len, "0 %d %d %d * *", rand() % 60, rand() % 24,
+                   1 + rand() % 28);
+    break;
+  }
+}
+
+static void bench(size_t entries, time_t bucket) {
+  cron_expr *exprs;
+  const char *errbuf = NULL;
+  char buf[64];
+  int64_t *counts;
+  int64_t runs = 0;
+  size_t buckets = WINDOW_DAYS * 86400 / (size_t)bucket;
+  unsigned long long start;
+  unsigned long long elapsed;
+  size_t i;
+
+  srand(1);
+
+  exprs = malloc(entries * sizeof(cron_expr));
+  counts = malloc(buckets * sizeof(int64_t));
+  if (exprs == NULL || counts == NULL)
+    err(EXIT_FAILURE, "error: malloc");
+
+  for (i = 0; i < entries; i++) {
+    expression(buf, sizeof(buf));
+    cron_parse_expr(buf, &exprs[i], &errbuf);
+    if (errbuf)
+      errx(EXIT_FAILURE, "error: %s: %s", buf, errbuf);
+  }
+
+  start = nsec();
+  if (cron_histogram(exprs, entries, WINDOW_START, bucket, buckets, counts) <
+      0)
+    errx(EXIT_FAILURE, "error: cron_histogram");
+  elapsed = nsec() - start;
+
+  for (i = 0; i < buckets; i++)
+    runs += counts[i];
+
+  (void)printf("%s\t%s\t%zu\t%lld\t%zu\t%lld\t%.1f\n", BENCH_BUILD,
+               BENCH_LIBC, entries, (long long)bucket, buckets,
+               (long long)runs, (double)elapsed / 1e6);
+
+  free(counts);
+  free(exprs);
+}
+
+int main(void) {
+  (void)cron_tz_init(NULL);
+
+  (void)printf("build\tlibc\tentries\tbucket\tbuckets\truns\tms\n");
+
+  bench(10000, 60);
+  bench(100000, 1);
+  bench(100000, 60);
+  bench(100000, 3600);
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2018-2023 Michael Santos <michael.santos@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures finding which of 10k, 100k and 1M expressions match a second
+ * with cron_index, compared with testing the fields of each compiled
+ * expression. Output is tab separated:
+ *
+ *   build  libc  simd  entries  bytes/entry  ns/match  ns/scan
+ *
+ * Build with -DCRON_TEST_MALLOC to count memory.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ccronexpr.h"
+
+#ifdef CRON_USE_LOCAL_TIME
+#define BENCH_BUILD "local"
+#else
+#define BENCH_BUILD "utc"
+#endif
+
+#if defined(__GLIBC__)
+#define BENCH_LIBC "glibc"
+#elif defined(__linux__)
+#define BENCH_LIBC "musl"
+#else
+#define BENCH_LIBC "libc"
+#endif
+
+/* same selection as ccronexpr.c */
+#if defined(CRON_NO_SIMD)
+#define BENCH_SIMD "none"
+#elif defined(__AVX2__)
+#define BENCH_SIMD "avx2"
+#elif defined(__SSE2__)
+#define BENCH_SIMD "sse2"
+#elif defined(__ARM_NEON)
+#define BENCH_SIMD "neon"
+#else
+#define BENCH_SIMD "none"
+#endif
+
+/* consecutive seconds matched for each size */
+#define SECONDS 1000
+
+static size_t allocated;
+
+#ifdef CRON_TEST_MALLOC
+/* the size is kept in a header before the block to account for free */
+#define HEADER 16
+
+void *cron_malloc(size_t n) {
+  size_t *p = malloc(n + HEADER);
+
+  if (p == NULL)
+    return NULL;
+
+  *p = n;
+  allocated += n;
+  return (char *)p + HEADER;
+}
+
+void cron_free(void *p) {
+  size_t *q = (size_t *)((char *)p - HEADER);
+
+  allocated -= *q;
+  free(q);
+}
+#endif
+
+static unsigned long long nsec(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    err(EXIT_FAILURE, "error: clock_gettime");
+
+  return (unsigned long long)ts.tv_sec * 1000000000ULL +
+         (unsigned long long)ts.tv_nsec;
+}
+
+/* a mix of schedules from every few seconds to daily */
+static void expression(char *buf, size_t len) {
+  switch (rand() % 5) {
+  case 0:
+    (void)snprintf(buf, len, "%d */%d * * * *", rand() % 60, 1 + rand() % 30);
+    break;
+  case 1:
+    (void)snprintf(buf, len, "*/%d * * * * *", 5 + rand() % 55);
+    break;
+  case 2:
+    (void)snprintf(buf, len, "%d %d * * * *", rand() % 60, rand() % 60);
+    break;
+  case 3:
+    (void)snprintf(buf, len, "0 %d %d * * 1-5", rand() % 60, rand() % 24);
+    break;
+  default:
+    (void)snprintf(buf, len, "0 %d %d %d * *", rand() % 60, rand() % 24,
+                   1 + rand() % 28);
+    break;
+  }
+}
+
+/* the expressions matching the local time, one at a time */
+static size_t scan(const cron_compiled *exprs, size_t n, time_t t) {
+  struct tm tm;
+  size_t matched = 0;
+  size_t i;
+
+#ifdef CRON_USE_LOCAL_TIME
+  if (localtime_r(&t, &tm) == NULL)
+#else
+  if (gmtime_r(&t, &tm) == NULL)
+#endif
+    errx(EXIT_FAILURE, "error: %lld", (long long)t);
+
+  for (i = 0; i < n; i++) {
+    if ((exprs[i].seconds >> tm.tm_sec & 1) &&
+        (exprs[i].minutes >> tm.tm_min & 1) &&
+        (exprs[i].hours >> tm.tm_hour & 1) &&
+        (exprs[i].days_of_month >> tm.tm_mday & 1) &&
+        (exprs[i].months >> tm.tm_mon & 1) &&
+        (exprs[i].days_of_week >> tm.tm_wday & 1))
+      matched++;
+  }
+
+  return matched;
+}
+
+static void bench(size_t entries) {
+  cron_index index;
+  cron_compiled *exprs;
+  cron_expr expr;
+  const char *errbuf = NULL;
+  char buf[64];
+  uint64_t *out;
+  unsigned long long start;
+  unsigned long long match;
+  unsigned long long run;
+  size_t bytes;
+  time_t now = 1700000000;
+  int64_t indexed = 0;
+  size_t scanned = 0;
+  size_t i;
+
+  srand(1);
+  cron_index_init(&index);
+
+  exprs = malloc(entries * sizeof(cron_compiled));
+  if (exprs == NULL)
+    err(EXIT_FAILURE, "error: malloc");
+
+  for (i = 0; i < entries; i++) {
+    expression(buf, sizeof(buf));
+    cron_parse_expr(buf, &expr, &errbuf);
+    if (errbuf)
+      errx(EXIT_FAILURE, "error: %s: %s", buf, errbuf);
+
+    if (cron_index_add(&index, &expr) < 0)
+      errx(EXIT_FAILURE, "error: cron_index_add");
+    cron_compile(&expr, &exprs[i]);
+  }
+  bytes = allocated;
+
+  out = malloc(cron_index_words(&index) * sizeof(uint64_t));
+  if (out == NULL)
+    err(EXIT_FAILURE, "error: malloc");
+
+  start = nsec();
+  for (i = 0; i < SECONDS; i++)
+    indexed += cron_index_match(&index, now + (time_t)i, out);
+  match = nsec() - start;
+
+  start = nsec();
+  for (i = 0; i < SECONDS; i++)
+    scanned += scan(exprs, entries, now + (time_t)i);
+  run = nsec() - start;
+
+  if (indexed != (int64_t)scanned)
+    errx(EXIT_FAILURE, "error: index matched %lld, scan matched %zu",
+         (long long)indexed, scanned);
+
+  (void)printf("%s\t%s\t%s\t%zu\t%.1f\t%.0f\t%.0f\n", BENCH_BUILD, BENCH_LIBC,
+               BENCH_SIMD, entries, (double)bytes / (double)entries,
+               (double)match / SECONDS, (double)run / SECONDS);
+
+  free(out);
+  free(exprs);
+  cron_index_free(&index);
+}
+
+int main(void) {
+  (void)cron_tz_init(NULL);
+
+  (void)printf(
+      "build\tlibc\tsimd\tentries\tbytes/entry\tns/match\tns/scan\n");
+
+  bench(10000);
+  bench(100000);
+  bench(1000000);
+
+  return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2018-2023 Michael Santos <michael.santos@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the cron_sched scheduler with 10k, 100k and 1M entries: the
+ * memory used per entry, the cost of parsing and adding entries, of
+ * opening and loading a schedule image of them instead and of running
+ * scheduled entries. Output is tab separated:
+ *
+ *   build  libc  entries  bytes/entry  ns/parse  ns/add  ns/load  ns/run
+ *   runs/s
+ *
+ * Build with -DCRON_TEST_MALLOC to count memory.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ccronexpr.h"
+
+#ifdef CRON_USE_LOCAL_TIME
+#define BENCH_BUILD "local"
+#else
+#define BENCH_BUILD "utc"
+#endif
+
+#if defined(__GLIBC__)
+#define BENCH_LIBC "glibc"
+#elif defined(__linux__)
+#define BENCH_LIBC "musl"
+#else
+#define BENCH_LIBC "libc"
+#endif
+
+/* runs measured for each size */
+#define RUNS 1000000
+
+static size_t allocated;
+
+#ifdef CRON_TEST_MALLOC
+/* the size is kept in a header before the block to account for free */
+#define HEADER 16
+
+void *cron_malloc(size_t n) {
+  size_t *p = malloc(n + HEADER);
+
+  if (p == NULL)
+    return NULL;
+
+  *p = n;
+  allocated += n;
+  return (char *)p + HEADER;
+}
+
+void cron_free(void *p) {
+  size_t *q = (size_t *)((char *)p - HEADER);
+
+  allocated -= *q;
+  free(q);
+}
+#endif
+
+static unsigned long long nsec(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    err(EXIT_FAILURE, "error: clock_gettime");
+
+  return (unsigned long long)ts.tv_sec * 1000000000ULL +
+         (unsigned long long)ts.tv_nsec;
+}
+
+/* a mix of schedules from every few seconds to daily */
+static void expression(char *buf, size_t len) {
+  switch (rand() % 5) {
+  case 0:
+    (void)snprintf(buf, len, "%d */%d * * * *", rand() % 60, 1 + rand() % 30);
+    break;
+  case 1:
+    (void)snprintf(buf, len, "*/%d * * * * *", 5 + rand() % 55);
+    break;
+  case 2:
+    (void)snprintf(buf, len, "%d %d * * * *", rand() % 60, rand() % 60);
+    break;
+  case 3:
+    (void)snprintf(buf, len, "0 %d %d * * 1-5", rand() % 60, rand() % 24);
+    break;
+  default:
+    (void)snprintf(buf, len, "0 %d %d %d * *", rand() % 60, rand() % 24,
+                   1 + rand() % 28);
+    break;
+  }
+}
+
+static void bench(size_t entries) {
+  cron_sched sched;
+  cron_sched loaded;
+  cron_image image;
+  cron_expr *exprs;
+  const char *errbuf = NULL;
+  char buf[64];
+  void *data;
+  size_t size;
+  size_t bytes;
+  unsigned long long start;
+  unsigned long long parse;
+  unsigned long long add;
+  unsigned long long load;
+  unsigned long long run;
+  time_t now = 1700000000;
+  time_t next;
+  uint32_t id;
+  time_t fire;
+  size_t i;
+
+  exprs = malloc(entries * sizeof(*exprs));
+  if (exprs == NULL)
+    err(EXIT_FAILURE, "error: malloc");
+
+  srand(1);
+  cron_sched_init(&sched);
+
+  parse = 0;
+  add = 0;
+  for (i = 0; i < entries; i++) {
+    expression(buf, sizeof(buf));
+    start = nsec();
+    cron_parse_expr(buf, &exprs[i], &errbuf);
+    parse += nsec() - start;
+    if (errbuf)
+      errx(EXIT_FAILURE, "error: %s: %s", buf, errbuf);
+
+    start = nsec();
+    if (cron_sched_add(&sched, &exprs[i], now) < 0)
+      errx(EXIT_FAILURE, "error: cron_sched_add");
+    add += nsec() - start;
+  }
+  bytes = allocated;
+
+  /* startup from an image: the expressions are used in place */
+  size = cron_image_write(exprs, NULL, entries, NULL, 0);
+  data = malloc(size);
+  if (data == NULL)
+    err(EXIT_FAILURE, "error: malloc");
+  (void)cron_image_write(exprs, NULL, entries, data, size);
+
+  start = nsec();
+  if (cron_image_open(&image, data, size, &errbuf) < 0)
+    errx(EXIT_FAILURE, "error: cron_image_open: %s", errbuf);
+  if (cron_sched_load(&loaded, image.exprs, image.len, now) < 0)
+    errx(EXIT_FAILURE, "error: cron_sched_load");
+  load = nsec() - start;
+  cron_sched_free(&loaded);
+
+  start = nsec();
+  for (i = 0; i < RUNS;) {
+    next = cron_sched_next(&sched);
+    if (next == -1)
+      errx(EXIT_FAILURE, "error: cron_sched_next");
+
+    while (i < RUNS && cron_sched_pop(&sched, next, &id, &fire))
+      i++;
+  }
+  run = nsec() - start;
+
+  (void)printf("%s\t%s\t%zu\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.0f\n",
+               BENCH_BUILD, BENCH_LIBC, entries,
+               (double)bytes / (double)entries, (double)parse / (double)entries,
+               (double)add / (double)entries, (double)load / (double)entries,
+               (double)run / RUNS, (double)RUNS * 1e9 / (double)run);
+
+  cron_sched_free(&sched);
+  free(data);
+  free(exprs);
+}
+
+int main(void) {
+  (void)cron_tz_init(NULL);
+
+  (void)printf(
+      "build\tlibc\tentries\tbytes/entry\tns/parse\tns/add\tns/load\tns/"
+      "run\truns/s\n");
+
+  bench(10000);
+  bench(100000);
+  bench(1000000);
+
+  return 0;
+}
@@ -31,13 +31,35 @@
 
 #include "ccronexpr.h"
 
+/* vector width used by cron_index_match, '-DCRON_NO_SIMD' for plain C */
+#ifndef CRON_NO_SIMD
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CRON_INDEX_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CRON_INDEX_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CRON_INDEX_NEON
+#endif
+#endif /* CRON_NO_SIMD */
+
 #define CRON_MAX_SECONDS 60
 #define CRON_MAX_MINUTES 60
 #define CRON_MAX_HOURS 24
 #define CRON_MAX_DAYS_OF_WEEK 8
 #define CRON_MAX_DAYS_OF_MONTH 32
 #define CRON_MAX_MONTHS 12
-#define CRON_MAX_YEARS_DIFF 4
+/* the Gregorian calendar repeats every 400 years */
+#define CRON_MAX_YEARS_DIFF 400
+#define CRON_MIN_YEAR -1000000
+#define CRON_MAX_YEAR 1000000
+/* local times of periodic expressions found without the calendar, well
+ * inside the years it searches */
+#define CRON_PERIOD_LIMIT ((int64_t) 900000 * 366 * 86400)
+/* bounds the number of UTC offset changes crossed by a search */
+#define CRON_MAX_SEGMENTS 256
 
 #define CRON_CF_SECOND 0
 #define CRON_CF_MINUTE 1
@@ -48,33 +70,31 @@
 #define CRON_CF_YEAR 6
 
 #define CRON_CF_ARR_LEN 7
+#define CRON_CF_BIT(field) (1U << (field))
+
+/*
+ * Bounds the passes of do_next/do_prev: a pass that does not match moves
+ * to a later minute, hour or day, and the day found matches the days of
+ * month, days of week and months.
+ */
+#define CRON_MAX_ITERATIONS 32
 
 #define CRON_INVALID_INSTANT ((time_t) -1)
 
+/* mask of the low n bits, n <= 64 */
+#define CRON_BITS(n) ((n) >= 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << (n)) - 1))
+#define CRON_HAS_BIT(bits, idx) (((uint64_t) (bits) >> (idx)) & 1)
+
+#ifndef CRON_DISABLE_PARSER
 static const char* const DAYS_ARR[] = { "SUN", "MON", "TUE", "WED", "THU", "FRI", "SAT" };
 #define CRON_DAYS_ARR_LEN 7
-static const char* const MONTHS_ARR[] = { "FOO", "JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC" };
+static const char* const MONTHS_ARR[] = { NULL, "JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC" };
 #define CRON_MONTHS_ARR_LEN 13
+#endif /* CRON_DISABLE_PARSER */
 
 #define CRON_MAX_STR_LEN_TO_SPLIT 256
-#define CRON_MAX_NUM_TO_SRING 1000000000
-/* computes number of digits in decimal number */
-#define CRON_NUM_OF_DIGITS(num) (abs(num) < 10 ? 1 : \
-                                (abs(num) < 100 ? 2 : \
-                                (abs(num) < 1000 ? 3 : \
-                                (abs(num) < 10000 ? 4 : \
-                                (abs(num) < 100000 ? 5 : \
-                                (abs(num) < 1000000 ? 6 : \
-                                (abs(num) < 10000000 ? 7 : \
-                                (abs(num) < 100000000 ? 8 : \
-                                (abs(num) < 1000000000 ? 9 : 10)))))))))
-
-#ifndef _WIN32
-struct tm *gmtime_r(const time_t *timep, struct tm *result);
-#ifdef CRON_USE_LOCAL_TIME
-struct tm *localtime_r(const time_t *timep, struct tm *result);
-#endif /* CRON_USE_LOCAL_TIME */
-#endif /* _WIN32 */
+#define CRON_FIELDS_LEN 6
+#define CRON_NAME_LEN 3
 
 #ifndef CRON_TEST_MALLOC
 #define cron_malloc(x) malloc(x);
@@ -84,70 +104,6 @@ void* cron_malloc(size_t n);
 void cron_free(void* p);
 #endif /* CRON_TEST_MALLOC */
 
-#ifdef __MINGW32__
-/* To avoid warning when building with mingw */
-time_t _mkgmtime(struct tm* tm);
-#endif /* __MINGW32__ */
-
-/* Defining 'cron_mktime' to use use UTC (default) or local time */
-#ifndef CRON_USE_LOCAL_TIME
-
-/* http://stackoverflow.com/a/22557778 */
-#ifdef _WIN32
-time_t cron_mktime(struct tm* tm) {
-    return _mkgmtime(tm);
-}
-#else /* !_WIN32 */
-#ifndef ANDROID
-/* can be hidden in time.h */
-time_t timegm(struct tm* __tp);
-#endif /* ANDROID */
-time_t cron_mktime(struct tm* tm) {
-#ifndef ANDROID
-    return timegm(tm);
-#else /* ANDROID */
-    /* https://github.com/adobe/chromium/blob/cfe5bf0b51b1f6b9fe239c2a3c2f2364da9967d7/base/os_compat_android.cc#L20 */
-    static const time_t kTimeMax = ~(1L << (sizeof (time_t) * CHAR_BIT - 1));
-    static const time_t kTimeMin = (1L << (sizeof (time_t) * CHAR_BIT - 1));
-    time64_t result = timegm64(tm);
-    if (result < kTimeMin || result > kTimeMax) return -1;
-    return result;
-#endif /* ANDROID */
-}
-#endif /* _WIN32 */
-
-struct tm* cron_time(time_t* date, struct tm* out) {
-#ifdef __MINGW32__
-    (void)(out); /* To avoid unused warning */
-    return gmtime(date);
-#else /* !__MINGW32__ */
-#ifdef _WIN32
-    errno_t err = gmtime_s(out, date);
-    return 0 == err ? out : NULL;
-#else /* !_WIN32 */
-    return gmtime_r(date, out);
-#endif /* _WIN32 */
-#endif /* __MINGW32__ */
-}
-
-#else /* CRON_USE_LOCAL_TIME */
-
-time_t cron_mktime(struct tm* tm) {
-    tm->tm_isdst = -1;
-    return mktime(tm);
-}
-
-struct tm* cron_time(time_t* date, struct tm* out) {
-#ifdef _WIN32
-    errno_t err = localtime_s(out, date);
-    return 0 == err ? out : NULL;
-#else /* _WIN32 */    
-    return localtime_r(date, out);
-#endif /* _WIN32 */    
-}
-
-#endif /* CRON_USE_LOCAL_TIME */
-
 void cron_set_bit(uint8_t* rbyte, int idx) {
     uint8_t j = (uint8_t) (idx / 8);
     uint8_t k = (uint8_t) (idx % 8);
@@ -173,184 +129,829 @@ uint8_t cron_get_bit(uint8_t* rbyte, int idx) {
     }
 }
 
-static void free_splitted(char** splitted, size_t len) {
-    size_t i;
-    if (!splitted) return;
+static const uint8_t DAYS_IN_MONTH[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+static int64_t floor_div(int64_t a, int64_t b) {
+    return a / b - (a % b < 0);
+}
+
+static int is_leap_year(int64_t year) {
+    return 0 == year % 4 && (0 != year % 100 || 0 == year % 400);
+}
+
+static int days_in_month(int64_t year, int mon) {
+    return DAYS_IN_MONTH[mon] + (1 == mon && is_leap_year(year));
+}
+
+/* 1970-01-01 was a Thursday */
+static int weekday(int64_t days) {
+    return (int) (days + 4 - floor_div(days + 4, 7) * 7);
+}
+
+/* http://howardhinnant.github.io/date_algorithms.html */
+static int64_t days_from_civil(int64_t year, int mon, int mday) {
+    int64_t era;
+    int64_t yoe;
+    int64_t doy;
+    int64_t doe;
+
+    year -= mon < 2;
+    era = floor_div(year, 400);
+    yoe = year - era * 400;
+    doy = (153 * (mon > 1 ? mon - 2 : mon + 10) + 2) / 5 + mday - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int64_t days, cron_cal* cal) {
+    int64_t z = days + 719468;
+    int64_t era = floor_div(z, 146097);
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+
+    cal->days = days;
+    cal->mday = (int) (doy - (153 * mp + 2) / 5 + 1);
+    cal->mon = (int) (mp < 10 ? mp + 2 : mp - 10);
+    cal->year = (int) (yoe + era * 400 + (cal->mon < 2));
+    cal->wday = weekday(days);
+}
+
+/**
+ * Carries out of range fields into the next field, like mktime(3).
+ */
+static int cal_normalize(cron_cal* cal) {
+    int64_t sod;
+    int64_t days;
+    int64_t year;
+
+    if (cal->year < CRON_MIN_YEAR || cal->year > CRON_MAX_YEAR) return 1;
+    if (cal->sec >= 0 && cal->sec < 60 && cal->min >= 0 && cal->min < 60 &&
+            cal->hour >= 0 && cal->hour < 24 && cal->mon >= 0 && cal->mon < 12 &&
+            cal->mday >= 1 && cal->mday <= days_in_month(cal->year, cal->mon)) {
+        cal->days = days_from_civil(cal->year, cal->mon, cal->mday);
+        cal->wday = weekday(cal->days);
+        return 0;
+    }
+
+    sod = (int64_t) cal->hour * 3600 + (int64_t) cal->min * 60 + cal->sec;
+    days = floor_div(sod, 86400);
+    sod -= days * 86400;
+    year = cal->year + floor_div(cal->mon, 12);
+    days += days_from_civil(year, (int) (cal->mon - floor_div(cal->mon, 12) * 12), 1) + cal->mday - 1;
+
+    civil_from_days(days, cal);
+    if (cal->year < CRON_MIN_YEAR || cal->year > CRON_MAX_YEAR) return 1;
+    cal->hour = (int) (sod / 3600);
+    cal->min = (int) (sod / 60 % 60);
+    cal->sec = (int) (sod % 60);
+    return 0;
+}
+
+/**
+ * Keeps the day of month inside the month after the month or the year
+ * moved, so that Jan 31 plus one month is Feb 28 rather than Mar 3.
+ */
+static void cal_clamp_day(cron_cal* cal) {
+    int64_t year = cal->year + floor_div(cal->mon, 12);
+    int dim = days_in_month(year, (int) (cal->mon - floor_div(cal->mon, 12) * 12));
+    if (cal->mday > dim) cal->mday = dim;
+}
+
+static int64_t cal_seconds(const cron_cal* cal) {
+    return cal->days * 86400 + cal->hour * 3600 + cal->min * 60 + cal->sec;
+}
+
+static void cal_from_seconds(cron_cal* cal, int64_t seconds) {
+    int64_t days = floor_div(seconds, 86400);
+    int64_t sod = seconds - days * 86400;
+
+    civil_from_days(days, cal);
+    cal->hour = (int) (sod / 3600);
+    cal->min = (int) (sod / 60 % 60);
+    cal->sec = (int) (sod % 60);
+}
+
+static time_t seconds_to_time(int64_t t) {
+    if ((int64_t) (time_t) t != t || CRON_INVALID_INSTANT == (time_t) t) return CRON_INVALID_INSTANT;
+    return (time_t) t;
+}
+
+/**
+ * A span of time with a constant UTC offset. Local times are searched
+ * one segment at a time and converted to UTC with the segment offset.
+ */
+typedef struct {
+    int64_t start; /* first instant of the segment or CRON_TZ_NONE */
+    int64_t end; /* first instant after the segment or CRON_TZ_NONE */
+    int32_t offset;
+    int32_t prev_offset; /* offset before start */
+    int32_t next_offset; /* offset from end */
+} cron_tz_segment;
+
+#define CRON_TZ_NONE INT64_MIN
+
+static int cron_dst_gap = CRON_DST_GAP_SHIFT;
+static int cron_dst_fold = CRON_DST_FOLD_ONCE;
+
+void cron_set_dst_policy(int gap, int fold) {
+    cron_dst_gap = gap;
+    cron_dst_fold = fold;
+}
+
+#ifndef CRON_USE_LOCAL_TIME
+
+int cron_tz_init(const char* tz) {
+    (void) tz;
+    return 0;
+}
+
+static void tz_segment(int64_t t, cron_tz_segment* seg) {
+    (void) t;
+    seg->start = CRON_TZ_NONE;
+    seg->end = CRON_TZ_NONE;
+    seg->offset = 0;
+    seg->prev_offset = 0;
+    seg->next_offset = 0;
+}
+
+#else /* CRON_USE_LOCAL_TIME */
+
+#define CRON_TZ_MAX_TIMES 2000
+#define CRON_TZ_MAX_TYPES 256
+#define CRON_TZ_MAX_FILE 65536
+#define CRON_TZ_MAX_PATH 1024
+#define CRON_TZ_DIR "/usr/share/zoneinfo"
+#define CRON_TZ_DEFAULT "/etc/localtime"
+
+/**
+ * Transition date of a POSIX TZ rule: Jn, n or Mm.w.d
+ */
+typedef struct {
+    char type; /* 'J', 'D' or 'M' */
+    int day;
+    int week;
+    int mon;
+    int32_t time; /* local time of the transition */
+} cron_tz_rule;
+
+/**
+ * Cached time zone: transitions from the TZif file and the POSIX TZ rule
+ * used after the last transition.
+ */
+static struct {
+    int loaded;
+    int count;
+    int64_t times[CRON_TZ_MAX_TIMES];
+    int32_t offsets[CRON_TZ_MAX_TIMES]; /* offset from times[i] */
+    int32_t initial_offset; /* offset before times[0] */
+    int has_rule;
+    int has_dst;
+    int32_t std_offset;
+    int32_t dst_offset;
+    cron_tz_rule start; /* standard to daylight saving time */
+    cron_tz_rule end; /* daylight saving to standard time */
+} cron_tz;
+
+static const char* tz_parse_name(const char* s) {
+    const char* p = s;
+    if ('<' == *p) {
+        while ('\0' != *p && '>' != *p) p++;
+        return '>' == *p ? p + 1 : NULL;
+    }
+    while (isalpha((unsigned char) *p)) p++;
+    return p - s < 3 ? NULL : p;
+}
+
+/* [+-]hh[:mm[:ss]] */
+static const char* tz_parse_time(const char* s, int32_t* secs) {
+    int sign = 1;
+    int32_t n[3] = { 0, 0, 0 };
+    int i;
+
+    if ('+' == *s || '-' == *s) {
+        if ('-' == *s) sign = -1;
+        s++;
+    }
+    for (i = 0; i < 3; i++) {
+        if (i > 0) {
+            if (':' != *s) break;
+            s++;
+        }
+        if (!isdigit((unsigned char) *s)) return NULL;
+        while (isdigit((unsigned char) *s)) {
+            n[i] = n[i] * 10 + (*s++ - '0');
+            if (n[i] > 167) return NULL;
+        }
+    }
+    *secs = sign * (n[0] * 3600 + n[1] * 60 + n[2]);
+    return s;
+}
+
+static const char* tz_parse_number(const char* s, int* n) {
+    if (!isdigit((unsigned char) *s)) return NULL;
+    *n = 0;
+    while (isdigit((unsigned char) *s)) {
+        *n = *n * 10 + (*s++ - '0');
+        if (*n > 366) return NULL;
+    }
+    return s;
+}
+
+static const char* tz_parse_rule(const char* s, cron_tz_rule* rule) {
+    if ('J' == *s) {
+        rule->type = 'J';
+        s = tz_parse_number(s + 1, &rule->day);
+        if (!s || rule->day < 1 || rule->day > 365) return NULL;
+    } else if ('M' == *s) {
+        rule->type = 'M';
+        s = tz_parse_number(s + 1, &rule->mon);
+        if (!s || '.' != *s || rule->mon < 1 || rule->mon > 12) return NULL;
+        s = tz_parse_number(s + 1, &rule->week);
+        if (!s || '.' != *s || rule->week < 1 || rule->week > 5) return NULL;
+        s = tz_parse_number(s + 1, &rule->day);
+        if (!s || rule->day > 6) return NULL;
+    } else {
+        rule->type = 'D';
+        s = tz_parse_number(s, &rule->day);
+        if (!s || rule->day > 365) return NULL;
+    }
+    rule->time = 7200;
+    if ('/' == *s) {
+        s = tz_parse_time(s + 1, &rule->time);
+    }
+    return s;
+}
+
+/**
+ * Parses a POSIX TZ string such as "EST5EDT,M3.2.0,M11.1.0".
+ */
+static int tz_parse_posix(const char* s) {
+    int32_t offset;
+
+    s = tz_parse_name(s);
+    if (!s) return -1;
+    s = tz_parse_time(s, &offset);
+    if (!s) return -1;
+    /* POSIX offsets are west of Greenwich */
+    cron_tz.std_offset = -offset;
+    cron_tz.dst_offset = cron_tz.std_offset;
+    cron_tz.has_dst = 0;
+    cron_tz.has_rule = 1;
+    if ('\0' == *s) return 0;
+
+    s = tz_parse_name(s);
+    if (!s) return -1;
+    cron_tz.has_dst = 1;
+    cron_tz.dst_offset = cron_tz.std_offset + 3600;
+    if ('\0' != *s && ',' != *s) {
+        s = tz_parse_time(s, &offset);
+        if (!s) return -1;
+        cron_tz.dst_offset = -offset;
+    }
+    if ('\0' == *s) {
+        /* no rule: use the US rules */
+        s = "M3.2.0,M11.1.0";
+    } else if (',' == *s) {
+        s++;
+    } else {
+        return -1;
+    }
+    s = tz_parse_rule(s, &cron_tz.start);
+    if (!s || ',' != *s) return -1;
+    s = tz_parse_rule(s + 1, &cron_tz.end);
+    if (!s || '\0' != *s) return -1;
+    return 0;
+}
+
+static int64_t tz_be(const unsigned char* p, int len) {
+    int i;
+    uint64_t n = 0;
     for (i = 0; i < len; i++) {
-        if (splitted[i]) {
-            cron_free(splitted[i]);
+        n = (n << 8) | p[i];
+    }
+    /* sign extend */
+    if (len < 8 && (n & ((uint64_t) 1 << (len * 8 - 1)))) {
+        n |= ~(uint64_t) 0 << (len * 8);
+    }
+    return (int64_t) n;
+}
+
+/**
+ * Parses a TZif file (RFC 8536), using the 64-bit data of version 2+ files.
+ */
+static int tz_parse_tzif(const unsigned char* buf, size_t len) {
+    const unsigned char* p = buf;
+    const unsigned char* end = buf + len;
+    int32_t types[CRON_TZ_MAX_TYPES];
+    int64_t isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt;
+    int timelen = 4;
+    int64_t i;
+
+    for (;;) {
+        if (end - p < 44 || 0 != memcmp(p, "TZif", 4)) return -1;
+        isutcnt = tz_be(p + 20, 4);
+        isstdcnt = tz_be(p + 24, 4);
+        leapcnt = tz_be(p + 28, 4);
+        timecnt = tz_be(p + 32, 4);
+        typecnt = tz_be(p + 36, 4);
+        charcnt = tz_be(p + 40, 4);
+        if (isutcnt < 0 || isstdcnt < 0 || leapcnt < 0 || timecnt < 0 || typecnt < 1 || charcnt < 0 ||
+                timecnt > CRON_TZ_MAX_TIMES || typecnt > CRON_TZ_MAX_TYPES) return -1;
+        if (4 == timelen && '\0' != p[4]) {
+            /* skip the version 1 data */
+            p += 44 + timecnt * 5 + typecnt * 6 + charcnt + leapcnt * 8 + isstdcnt + isutcnt;
+            timelen = 8;
+            continue;
+        }
+        p += 44;
+        break;
+    }
+    if (end - p < timecnt * (timelen + 1) + typecnt * 6 + charcnt + leapcnt * (timelen + 4) + isstdcnt + isutcnt) return -1;
+
+    for (i = 0; i < typecnt; i++) {
+        types[i] = (int32_t) tz_be(p + timecnt * (timelen + 1) + i * 6, 4);
+    }
+    for (i = 0; i < timecnt; i++) {
+        unsigned char type = p[timecnt * timelen + i];
+        if (type >= typecnt) return -1;
+        cron_tz.times[i] = tz_be(p + i * timelen, timelen);
+        cron_tz.offsets[i] = types[type];
+    }
+    cron_tz.count = (int) timecnt;
+    cron_tz.initial_offset = types[0];
+    cron_tz.has_rule = 0;
+    p += timecnt * (timelen + 1) + typecnt * 6 + charcnt + leapcnt * (timelen + 4) + isstdcnt + isutcnt;
+
+    /* version 2+ footer: newline enclosed POSIX TZ string */
+    if (8 == timelen && end - p > 2 && '\n' == *p && '\n' != p[1]) {
+        char rule[CRON_TZ_MAX_PATH];
+        size_t rlen = 0;
+        for (p++; p < end && '\n' != *p && rlen < sizeof(rule) - 1; p++) {
+            rule[rlen++] = (char) *p;
+        }
+        rule[rlen] = '\0';
+        if (0 != tz_parse_posix(rule)) {
+            cron_tz.has_rule = 0;
         }
     }
-    cron_free(splitted);
+    return 0;
 }
 
-static char* strdupl(const char* str, size_t len) {
-    if (!str) return NULL;
-    char* res = (char*) cron_malloc(len + 1);
-    if (!res) return NULL;
-    memset(res, 0, len + 1);
-    memcpy(res, str, len);
-    return res;
+static int tz_load_file(const char* path) {
+    FILE* fp;
+    unsigned char* buf;
+    size_t len;
+    int rv = -1;
+
+    fp = fopen(path, "rb");
+    if (!fp) return -1;
+    buf = (unsigned char*) cron_malloc(CRON_TZ_MAX_FILE);
+    if (buf) {
+        len = fread(buf, 1, CRON_TZ_MAX_FILE, fp);
+        if (!ferror(fp) && len < CRON_TZ_MAX_FILE) {
+            rv = tz_parse_tzif(buf, len);
+        }
+        cron_free(buf);
+    }
+    fclose(fp);
+    return rv;
 }
 
-static unsigned int next_set_bit(uint8_t* bits, unsigned int max, unsigned int from_index, int* notfound) {
-    unsigned int i;
-    if (!bits) {
-        *notfound = 1;
+int cron_tz_init(const char* tz) {
+    char path[CRON_TZ_MAX_PATH];
+    const char* dir;
+    int rv;
+
+    memset(&cron_tz, 0, sizeof(cron_tz));
+    cron_tz.loaded = 1;
+
+    if (!tz) {
+        tz = getenv("TZ");
+    }
+    if (!tz) {
+        tz = CRON_TZ_DEFAULT;
+    }
+    if (':' == *tz) {
+        tz++;
+    }
+    /* an empty TZ is UTC */
+    if ('\0' == *tz) return 0;
+
+    if ('/' == *tz) {
+        rv = snprintf(path, sizeof(path), "%s", tz);
+    } else {
+        dir = getenv("TZDIR");
+        rv = snprintf(path, sizeof(path), "%s/%s", dir ? dir : CRON_TZ_DIR, tz);
+    }
+    if (rv > 0 && (size_t) rv < sizeof(path) && 0 == tz_load_file(path)) {
         return 0;
     }
-    for (i = from_index; i < max; i++) {
-        if (cron_get_bit(bits, i)) return i;
+
+    memset(&cron_tz, 0, sizeof(cron_tz));
+    cron_tz.loaded = 1;
+    if (0 == tz_parse_posix(tz)) return 0;
+
+    /* fall back to UTC */
+    memset(&cron_tz, 0, sizeof(cron_tz));
+    cron_tz.loaded = 1;
+    return -1;
+}
+
+/**
+ * Returns the UTC instant of a rule transition in the given year.
+ */
+static int64_t tz_rule_time(const cron_tz_rule* rule, int year, int32_t offset) {
+    int64_t days = days_from_civil(year, 0, 1);
+
+    switch (rule->type) {
+    case 'J':
+        /* 1-365, February 29 is never counted */
+        days += rule->day - 1 + (is_leap_year(year) && rule->day >= 60);
+        break;
+    case 'D':
+        days += rule->day;
+        break;
+    default: {
+        /* day d of week w (5 is the last) of month m */
+        int first = weekday(days_from_civil(year, rule->mon - 1, 1));
+        int mday = 1 + (rule->day - first + 7) % 7 + (rule->week - 1) * 7;
+        while (mday > days_in_month(year, rule->mon - 1)) {
+            mday -= 7;
+        }
+        days = days_from_civil(year, rule->mon - 1, mday);
+    } break;
     }
-    *notfound = 1;
-    return 0;
+    return days * 86400 + rule->time - offset;
 }
 
-static void push_to_fields_arr(int* arr, int fi) {
+/**
+ * Finds the rule transitions nearest to t: the last at or before t and
+ * the first after t.
+ */
+static void tz_rule_segment(int64_t t, cron_tz_segment* seg) {
+    cron_cal cal;
+    int64_t when[6];
+    int32_t after[6];
+    int n = 0;
+    int year;
     int i;
-    if (!arr || -1 == fi) {
-        return;
+
+    seg->offset = cron_tz.std_offset;
+    seg->prev_offset = cron_tz.std_offset;
+    seg->next_offset = cron_tz.std_offset;
+    if (!cron_tz.has_dst) return;
+
+    cal_from_seconds(&cal, t);
+    for (year = cal.year - 1; year <= cal.year + 1; year++) {
+        int64_t start = tz_rule_time(&cron_tz.start, year, cron_tz.std_offset);
+        int64_t end = tz_rule_time(&cron_tz.end, year, cron_tz.dst_offset);
+        if (start < end) {
+            when[n] = start;
+            after[n++] = cron_tz.dst_offset;
+            when[n] = end;
+            after[n++] = cron_tz.std_offset;
+        } else {
+            /* southern hemisphere */
+            when[n] = end;
+            after[n++] = cron_tz.std_offset;
+            when[n] = start;
+            after[n++] = cron_tz.dst_offset;
+        }
     }
-    for (i = 0; i < CRON_CF_ARR_LEN; i++) {
-        if (arr[i] == fi) return;
+    for (i = 0; i < n; i++) {
+        if (when[i] > t) break;
     }
-    for (i = 0; i < CRON_CF_ARR_LEN; i++) {
-        if (-1 == arr[i]) {
-            arr[i] = fi;
-            return;
+    /* the years around t always include transitions on both sides */
+    if (0 == i || n == i) return;
+    seg->start = when[i - 1];
+    seg->offset = after[i - 1];
+    seg->prev_offset = after[i - 1] == cron_tz.dst_offset ? cron_tz.std_offset : cron_tz.dst_offset;
+    seg->end = when[i];
+    seg->next_offset = after[i];
+}
+
+static void tz_segment(int64_t t, cron_tz_segment* seg) {
+    int lo = 0;
+    int hi;
+    int mid;
+
+    if (!cron_tz.loaded) {
+        (void) cron_tz_init(NULL);
+    }
+
+    seg->start = CRON_TZ_NONE;
+    seg->end = CRON_TZ_NONE;
+
+    /* index of the first transition after t */
+    hi = cron_tz.count;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (cron_tz.times[mid] <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == cron_tz.count && cron_tz.has_rule) {
+        tz_rule_segment(t, seg);
+        if (lo > 0 && (CRON_TZ_NONE == seg->start || seg->start <= cron_tz.times[lo - 1])) {
+            /* the table ends within this segment */
+            seg->start = cron_tz.times[lo - 1];
+            seg->offset = cron_tz.offsets[lo - 1];
+            seg->prev_offset = lo > 1 ? cron_tz.offsets[lo - 2] : cron_tz.initial_offset;
         }
+        return;
+    }
+
+    seg->offset = lo > 0 ? cron_tz.offsets[lo - 1] : cron_tz.initial_offset;
+    if (lo > 0) {
+        seg->start = cron_tz.times[lo - 1];
+        seg->prev_offset = lo > 1 ? cron_tz.offsets[lo - 2] : cron_tz.initial_offset;
+    } else {
+        seg->prev_offset = seg->offset;
+    }
+    if (lo < cron_tz.count) {
+        seg->end = cron_tz.times[lo];
+        seg->next_offset = cron_tz.offsets[lo];
+    } else {
+        seg->next_offset = seg->offset;
+    }
+}
+
+#endif /* CRON_USE_LOCAL_TIME */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define cron_ctz64(x) ((unsigned int) __builtin_ctzll(x))
+#define cron_clz64(x) ((unsigned int) __builtin_clzll(x))
+#define cron_popcount64(x) ((unsigned int) __builtin_popcountll(x))
+#else
+static unsigned int cron_ctz64(uint64_t x) {
+    unsigned int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+
+static unsigned int cron_clz64(uint64_t x) {
+    unsigned int n = 0;
+    while (!(x & ((uint64_t) 1 << 63))) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+}
+
+static unsigned int cron_popcount64(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (unsigned int) ((x * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+static uint64_t bytes_to_word(const uint8_t* bytes, size_t len) {
+    size_t i;
+    uint64_t word = 0;
+    for (i = 0; i < len; i++) {
+        word |= (uint64_t) bytes[i] << (8 * i);
+    }
+    return word;
+}
+
+/**
+ * Gets the step of a field matching exactly 'phase + k * step' for every
+ * k, with the step dividing the field size, or 0. A single value is a step
+ * of the field size.
+ */
+static unsigned int field_step(uint64_t bits, unsigned int size, unsigned int* phase) {
+    unsigned int first;
+    unsigned int step;
+    unsigned int i;
+    uint64_t want = 0;
+
+    if (!bits) return 0;
+    first = cron_ctz64(bits);
+    step = (bits & (bits - 1)) ? cron_ctz64(bits & (bits - 1)) - first : size;
+    if (first >= step || 0 != size % step) return 0;
+    for (i = first; i < size; i += step) {
+        want |= (uint64_t) 1 << i;
+    }
+    if (want != bits) return 0;
+    *phase = first;
+    return step;
+}
+
+/**
+ * Expressions matching every day at times of day a constant period apart
+ * have a period and a phase in seconds: local times t match when
+ * (t - phase) % period is 0.
+ */
+static void compile_period(cron_compiled* target) {
+    unsigned int sec = 0;
+    unsigned int min = 0;
+    unsigned int hour = 0;
+    unsigned int sec_step;
+    unsigned int min_step;
+    unsigned int hour_step;
+
+    if (target->days_of_month != (CRON_BITS(CRON_MAX_DAYS_OF_MONTH) & ~(uint64_t) 1) ||
+            target->months != CRON_BITS(CRON_MAX_MONTHS) ||
+            target->days_of_week != CRON_BITS(CRON_MAX_DAYS_OF_WEEK - 1)) return;
+
+    sec_step = field_step(target->seconds, CRON_MAX_SECONDS, &sec);
+    min_step = field_step(target->minutes, CRON_MAX_MINUTES, &min);
+    hour_step = field_step(target->hours, CRON_MAX_HOURS, &hour);
+    if (!sec_step || !min_step || !hour_step) return;
+
+    if (1 == min_step && 1 == hour_step) {
+        /* every minute: a period of seconds */
+        target->period = sec_step;
+        target->phase = sec;
+    } else if (CRON_MAX_SECONDS == sec_step && 1 == hour_step) {
+        target->period = 60 * min_step;
+        target->phase = 60 * min + sec;
+    } else if (CRON_MAX_SECONDS == sec_step && CRON_MAX_MINUTES == min_step) {
+        target->period = 3600 * hour_step;
+        target->phase = 3600 * hour + 60 * min + sec;
     }
 }
 
-static int add_to_field(struct tm* calendar, int field, int val) {
+void cron_compile(const cron_expr* expr, cron_compiled* target) {
+    uint64_t days_of_week;
+
+    memset(target, 0, sizeof(cron_compiled));
+    target->seconds = bytes_to_word(expr->seconds, sizeof(expr->seconds)) & CRON_BITS(CRON_MAX_SECONDS);
+    target->minutes = bytes_to_word(expr->minutes, sizeof(expr->minutes)) & CRON_BITS(CRON_MAX_MINUTES);
+    target->hours = (uint32_t) (bytes_to_word(expr->hours, sizeof(expr->hours)) & CRON_BITS(CRON_MAX_HOURS));
+    target->days_of_month = (uint32_t) (bytes_to_word(expr->days_of_month, sizeof(expr->days_of_month)) & (CRON_BITS(CRON_MAX_DAYS_OF_MONTH) & ~(uint64_t) 1));
+    target->months = (uint16_t) (bytes_to_word(expr->months, sizeof(expr->months)) & CRON_BITS(CRON_MAX_MONTHS));
+    days_of_week = bytes_to_word(expr->days_of_week, sizeof(expr->days_of_week));
+    /* Sunday can be represented as 0 or 7 */
+    if (days_of_week & (1 << 7)) {
+        days_of_week |= 1;
+    }
+    target->days_of_week = (uint8_t) (days_of_week & CRON_BITS(CRON_MAX_DAYS_OF_WEEK - 1));
+    compile_period(target);
+}
+
+/* the first local time of a periodic expression after 'from' */
+static int64_t period_next(const cron_compiled* expr, int64_t from) {
+    int64_t t = from - expr->phase;
+    return from + expr->period - (t - floor_div(t, expr->period) * expr->period);
+}
+
+/* the last local time of a periodic expression before 'from' */
+static int64_t period_prev(const cron_compiled* expr, int64_t from) {
+    int64_t t = from - 1 - expr->phase;
+    return from - 1 - (t - floor_div(t, expr->period) * expr->period);
+}
+
+static int is_periodic(const cron_compiled* expr, int64_t from) {
+    return 0 != expr->period && from > -CRON_PERIOD_LIMIT && from < CRON_PERIOD_LIMIT;
+}
+
+static unsigned int next_set_bit(uint64_t bits, unsigned int max, unsigned int from_index, int* notfound) {
+    if (from_index >= max) goto return_notfound;
+    bits &= CRON_BITS(max) & (~(uint64_t) 0 << from_index);
+    if (!bits) goto return_notfound;
+    return cron_ctz64(bits);
+
+    return_notfound:
+    *notfound = 1;
+    return 0;
+}
+
+static int add_to_field(cron_cal* calendar, int field, int val) {
     if (!calendar || -1 == field) {
         return 1;
     }
     switch (field) {
     case CRON_CF_SECOND:
-        calendar->tm_sec = calendar->tm_sec + val;
+        calendar->sec = calendar->sec + val;
         break;
     case CRON_CF_MINUTE:
-        calendar->tm_min = calendar->tm_min + val;
+        calendar->min = calendar->min + val;
         break;
     case CRON_CF_HOUR_OF_DAY:
-        calendar->tm_hour = calendar->tm_hour + val;
+        calendar->hour = calendar->hour + val;
         break;
     case CRON_CF_DAY_OF_WEEK: /* mkgmtime ignores this field */
     case CRON_CF_DAY_OF_MONTH:
-        calendar->tm_mday = calendar->tm_mday + val;
+        calendar->mday = calendar->mday + val;
         break;
     case CRON_CF_MONTH:
-        calendar->tm_mon = calendar->tm_mon + val;
+        calendar->mon = calendar->mon + val;
+        cal_clamp_day(calendar);
         break;
     case CRON_CF_YEAR:
-        calendar->tm_year = calendar->tm_year + val;
+        calendar->year = calendar->year + val;
+        cal_clamp_day(calendar);
         break;
     default:
         return 1; /* unknown field */
     }
-    time_t res = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == res) {
-        return 1;
-    }
-    return 0;
+    return cal_normalize(calendar);
 }
 
 /**
  * Reset the calendar setting all the fields provided to zero.
  */
-static int reset_min(struct tm* calendar, int field) {
+static int reset_min(cron_cal* calendar, int field) {
     if (!calendar || -1 == field) {
         return 1;
     }
+    /* times of day in range leave the date unchanged: no need to normalize */
     switch (field) {
     case CRON_CF_SECOND:
-        calendar->tm_sec = 0;
-        break;
+        calendar->sec = 0;
+        return 0;
     case CRON_CF_MINUTE:
-        calendar->tm_min = 0;
-        break;
+        calendar->min = 0;
+        return 0;
     case CRON_CF_HOUR_OF_DAY:
-        calendar->tm_hour = 0;
-        break;
+        calendar->hour = 0;
+        return 0;
     case CRON_CF_DAY_OF_WEEK:
-        calendar->tm_wday = 0;
+        calendar->wday = 0;
         break;
     case CRON_CF_DAY_OF_MONTH:
-        calendar->tm_mday = 1;
+        calendar->mday = 1;
         break;
     case CRON_CF_MONTH:
-        calendar->tm_mon = 0;
+        calendar->mon = 0;
         break;
     case CRON_CF_YEAR:
-        calendar->tm_year = 0;
+        calendar->year = 0;
         break;
     default:
         return 1; /* unknown field */
     }
-    time_t res = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == res) {
-        return 1;
-    }
-    return 0;
+    return cal_normalize(calendar);
 }
 
-static int reset_all_min(struct tm* calendar, int* fields) {
+static int reset_all_min(cron_cal* calendar, unsigned int fields) {
     int i;
     int res = 0;
-    if (!calendar || !fields) {
+    if (!calendar) {
         return 1;
     }
     for (i = 0; i < CRON_CF_ARR_LEN; i++) {
-        if (-1 != fields[i]) {
-            res = reset_min(calendar, fields[i]);
+        if (fields & CRON_CF_BIT(i)) {
+            res = reset_min(calendar, i);
             if (0 != res) return res;
         }
     }
     return 0;
 }
 
-static int set_field(struct tm* calendar, int field, int val) {
+static int set_field(cron_cal* calendar, int field, int val) {
     if (!calendar || -1 == field) {
         return 1;
     }
+    /* times of day in range leave the date unchanged: no need to normalize */
     switch (field) {
     case CRON_CF_SECOND:
-        calendar->tm_sec = val;
+        calendar->sec = val;
+        if (val >= 0 && val < 60) return 0;
         break;
     case CRON_CF_MINUTE:
-        calendar->tm_min = val;
+        calendar->min = val;
+        if (val >= 0 && val < 60) return 0;
         break;
     case CRON_CF_HOUR_OF_DAY:
-        calendar->tm_hour = val;
+        calendar->hour = val;
+        if (val >= 0 && val < 24) return 0;
         break;
     case CRON_CF_DAY_OF_WEEK:
-        calendar->tm_wday = val;
+        calendar->wday = val;
         break;
     case CRON_CF_DAY_OF_MONTH:
-        calendar->tm_mday = val;
+        calendar->mday = val;
         break;
     case CRON_CF_MONTH:
-        calendar->tm_mon = val;
+        calendar->mon = val;
+        cal_clamp_day(calendar);
         break;
     case CRON_CF_YEAR:
-        calendar->tm_year = val;
+        calendar->year = val;
+        cal_clamp_day(calendar);
         break;
     default:
         return 1; /* unknown field */
     }
-    time_t res = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == res) {
-        return 1;
-    }
-    return 0;
+    return cal_normalize(calendar);
 }
 
 /**
  * Search the bits provided for the next set bit after the value provided,
  * and reset the calendar.
  */
-static unsigned int find_next(uint8_t* bits, unsigned int max, unsigned int value, struct tm* calendar, unsigned int field, unsigned int nextField, int* lower_orders, int* res_out) {
+static unsigned int find_next(uint64_t bits, unsigned int max, unsigned int value, cron_cal* calendar, unsigned int field, unsigned int nextField, unsigned int lower_orders, int* res_out) {
     int notfound = 0;
     int err = 0;
     unsigned int next_value = next_set_bit(bits, max, value, &notfound);
@@ -376,462 +977,339 @@ static unsigned int find_next(uint8_t* bits, unsigned int max, unsigned int valu
     return 0;
 }
 
-static unsigned int find_next_day(struct tm* calendar, uint8_t* days_of_month, unsigned int day_of_month, uint8_t* days_of_week, unsigned int day_of_week, int* resets, int* res_out) {
-    int err;
-    unsigned int count = 0;
-    unsigned int max = 366;
-    while ((!cron_get_bit(days_of_month, day_of_month) || !cron_get_bit(days_of_week, day_of_week)) && count++ < max) {
-        err = add_to_field(calendar, CRON_CF_DAY_OF_MONTH, 1);
+/* days of a month starting on 'wday' that fall on the days of week: bit n for day n */
+static uint32_t month_days_of_week(uint8_t days_of_week, int wday) {
+    uint64_t week = ((uint64_t) days_of_week >> wday | (uint64_t) days_of_week << (7 - wday)) & 0x7f;
+    return (uint32_t) (week * 0x10204081ULL << 1);
+}
 
-        if (err) goto return_error;
-        day_of_month = calendar->tm_mday;
-        day_of_week = calendar->tm_wday;
-        reset_all_min(calendar, resets);
+/* days of the month matching the days of month and days of week */
+static uint32_t month_days(const cron_compiled* expr, int64_t year, int mon) {
+    return expr->days_of_month &
+            month_days_of_week(expr->days_of_week, weekday(days_from_civil(year, mon, 1))) &
+            (uint32_t) CRON_BITS(days_in_month(year, mon) + 1);
+}
+
+/**
+ * Moves the calendar to the first day from its date matching the days of
+ * month, days of week and months. Months without a matching day are
+ * skipped whole, for at most CRON_MAX_YEARS_DIFF years.
+ */
+static void find_next_day(cron_cal* calendar, const cron_compiled* expr, unsigned int resets, int* res_out) {
+    int64_t year = calendar->year;
+    int mon = calendar->mon;
+    int from = calendar->mday;
+    uint32_t days;
+    int i;
+
+    for (i = 0; i <= 12 * CRON_MAX_YEARS_DIFF; i++) {
+        days = CRON_HAS_BIT(expr->months, mon) ? month_days(expr, year, mon) & ~(uint32_t) CRON_BITS(from) : 0;
+        if (days) {
+            if (year != calendar->year || mon != calendar->mon || (int) cron_ctz64(days) != calendar->mday) {
+                calendar->year = (int) year;
+                calendar->mon = mon;
+                calendar->mday = (int) cron_ctz64(days);
+                if (0 != cal_normalize(calendar) || 0 != reset_all_min(calendar, resets)) goto return_error;
+            }
+            return;
+        }
+        from = 1;
+        if (12 == ++mon) {
+            mon = 0;
+            year++;
+        }
     }
-    return day_of_month;
+    *res_out = -1;
+    return;
 
     return_error:
     *res_out = 1;
-    return 0;
 }
 
-static int do_next(cron_expr* expr, struct tm* calendar, unsigned int dot) {
+static int do_next(const cron_compiled* expr, cron_cal* calendar) {
     int i;
     int res = 0;
-    int* resets = NULL;
-    int* empty_list = NULL;
-    unsigned int second = 0;
-    unsigned int update_second = 0;
+    unsigned int resets;
     unsigned int minute = 0;
     unsigned int update_minute = 0;
     unsigned int hour = 0;
     unsigned int update_hour = 0;
-    unsigned int day_of_week = 0;
-    unsigned int day_of_month = 0;
-    unsigned int update_day_of_month = 0;
-    unsigned int month = 0;
-    unsigned int update_month = 0;
-
-    resets = (int*) cron_malloc(CRON_CF_ARR_LEN * sizeof(int));
-    if (!resets) goto return_result;
-    empty_list = (int*) cron_malloc(CRON_CF_ARR_LEN * sizeof(int));
-    if (!empty_list) goto return_result;
-    for (i = 0; i < CRON_CF_ARR_LEN; i++) {
-        resets[i] = -1;
-        empty_list[i] = -1;
+    int64_t day = 0;
+
+    /* start over from the seconds whenever a higher order field changes */
+    for (i = 0; i < CRON_MAX_ITERATIONS; i++) {
+        find_next(expr->seconds, CRON_MAX_SECONDS, calendar->sec, calendar, CRON_CF_SECOND, CRON_CF_MINUTE, 0, &res);
+        if (0 != res) return res;
+        resets = CRON_CF_BIT(CRON_CF_SECOND);
+
+        minute = calendar->min;
+        update_minute = find_next(expr->minutes, CRON_MAX_MINUTES, minute, calendar, CRON_CF_MINUTE, CRON_CF_HOUR_OF_DAY, resets, &res);
+        if (0 != res) return res;
+        if (minute != update_minute) continue;
+        resets |= CRON_CF_BIT(CRON_CF_MINUTE);
+
+        hour = calendar->hour;
+        update_hour = find_next(expr->hours, CRON_MAX_HOURS, hour, calendar, CRON_CF_HOUR_OF_DAY, CRON_CF_DAY_OF_WEEK, resets, &res);
+        if (0 != res) return res;
+        if (hour != update_hour) continue;
+        resets |= CRON_CF_BIT(CRON_CF_HOUR_OF_DAY);
+
+        day = calendar->days;
+        find_next_day(calendar, expr, resets, &res);
+        if (0 != res) return res;
+        if (day != calendar->days) continue;
+        return 0;
     }
+    return -1;
+}
 
-    second = calendar->tm_sec;
-    update_second = find_next(expr->seconds, CRON_MAX_SECONDS, second, calendar, CRON_CF_SECOND, CRON_CF_MINUTE, empty_list, &res);
-    if (0 != res) goto return_result;
-    if (second == update_second) {
-        push_to_fields_arr(resets, CRON_CF_SECOND);
-    }
+/* '-DCRON_DISABLE_PARSER' leaves out the parser, for expressions compiled in
+ * with 'pseudocron --emit-c' */
+#ifndef CRON_DISABLE_PARSER
 
-    minute = calendar->tm_min;
-    update_minute = find_next(expr->minutes, CRON_MAX_MINUTES, minute, calendar, CRON_CF_MINUTE, CRON_CF_HOUR_OF_DAY, resets, &res);
-    if (0 != res) goto return_result;
-    if (minute == update_minute) {
-        push_to_fields_arr(resets, CRON_CF_MINUTE);
-    } else {
-        res = do_next(expr, calendar, dot);
-        if (0 != res) goto return_result;
-    }
+/**
+ * A field of the expression, parsed in place without copying.
+ */
+typedef struct {
+    const char* begin;
+    const char* end;
+} cron_slice;
+
+typedef struct {
+    const char* const* names; /* names accepted in place of numbers, or NULL */
+    unsigned int names_len;
+    const char* error;
+    const char* error_at;
+    uint64_t hash; /* value of H tokens in the field */
+    unsigned int hash_max; /* end of the field range for H, or 0 for max */
+} cron_parser;
+
+/* FNV-1a hash of the seed, the empty string by default */
+static uint64_t cron_hash_seed = 0xcbf29ce484222325ULL;
+
+void cron_set_hash_seed(const char* seed) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; seed && '\0' != *seed; seed++) {
+        h ^= (unsigned char) *seed;
+        h *= 0x100000001b3ULL;
+    }
+    cron_hash_seed = h;
+}
 
-    hour = calendar->tm_hour;
-    update_hour = find_next(expr->hours, CRON_MAX_HOURS, hour, calendar, CRON_CF_HOUR_OF_DAY, CRON_CF_DAY_OF_WEEK, resets, &res);
-    if (0 != res) goto return_result;
-    if (hour == update_hour) {
-        push_to_fields_arr(resets, CRON_CF_HOUR_OF_DAY);
-    } else {
-        res = do_next(expr, calendar, dot);
-        if (0 != res) goto return_result;
-    }
+/**
+ * Derives the value of H tokens in a field from the seed, so that fields
+ * of the same expression do not all resolve to the same offset.
+ */
+static uint64_t hash_field(int field) {
+    uint64_t h = cron_hash_seed + (uint64_t) (field + 1) * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
 
-    day_of_week = calendar->tm_wday;
-    day_of_month = calendar->tm_mday;
-    update_day_of_month = find_next_day(calendar, expr->days_of_month, day_of_month, expr->days_of_week, day_of_week, resets, &res);
-    if (0 != res) goto return_result;
-    if (day_of_month == update_day_of_month) {
-        push_to_fields_arr(resets, CRON_CF_DAY_OF_MONTH);
-    } else {
-        res = do_next(expr, calendar, dot);
-        if (0 != res) goto return_result;
-    }
+static void parser_error(cron_parser* parser, const char* at, const char* error) {
+    /* keep the first error reported */
+    if (parser->error) return;
+    parser->error = error;
+    parser->error_at = at;
+}
 
-    month = calendar->tm_mon; /*day already adds one if no day in same month is found*/
-    update_month = find_next(expr->months, CRON_MAX_MONTHS, month, calendar, CRON_CF_MONTH, CRON_CF_YEAR, resets, &res);
-    if (0 != res) goto return_result;
-    if (month != update_month) {
-        if (calendar->tm_year - dot > 4) {
-            res = -1;
-            goto return_result;
-        }
-        res = do_next(expr, calendar, dot);
-        if (0 != res) goto return_result;
+static const char* find_char(cron_slice str, char ch) {
+    const char* c;
+    for (c = str.begin; c < str.end; c++) {
+        if (*c == ch) return c;
     }
-    goto return_result;
+    return NULL;
+}
 
-    return_result:
-    if (!resets || !empty_list) {
-        res = -1;
-    }
-    if (resets) {
-        cron_free(resets);
-    }
-    if (empty_list) {
-        cron_free(empty_list);
-    }
-    return res;
+static int slice_is(cron_slice str, char ch) {
+    return 1 == str.end - str.begin && ch == str.begin[0];
 }
 
-static int to_upper(char* str) {
-    if (!str) return 1;
-    int i;
-    for (i = 0; '\0' != str[i]; i++) {
-        int c = (int)str[i];
-        str[i] = (char) toupper(c);
+static unsigned int parse_uint(cron_slice str, int* errcode) {
+    const char* c;
+    unsigned int l = 0;
+    if (str.begin == str.end) goto return_error;
+    for (c = str.begin; c < str.end; c++) {
+        if (*c < '0' || *c > '9') goto return_error;
+        if (l > (INT_MAX - 9) / 10) goto return_error;
+        l = l * 10 + (unsigned int) (*c - '0');
     }
+    *errcode = 0;
+    return l;
+
+    return_error:
+    *errcode = 1;
     return 0;
 }
 
-static char* to_string(int num) {
-    if (abs(num) >= CRON_MAX_NUM_TO_SRING) return NULL;
-    char* str = (char*) cron_malloc(CRON_NUM_OF_DIGITS(num) + 1);
-    if (!str) return NULL;
-    int res = sprintf(str, "%d", num);
-    if (res < 0) {
-        cron_free(str);
-        return NULL;
-    }
-    return str;
-}
-
-static char* str_replace(char *orig, const char *rep, const char *with) {
-    char *result; /* the return string */
-    char *ins; /* the next insert point */
-    char *tmp; /* varies */
-    size_t len_rep; /* length of rep */
-    size_t len_with; /* length of with */
-    size_t len_front; /* distance between rep and end of last rep */
-    int count; /* number of replacements */
-    if (!orig) return NULL;
-    if (!rep) rep = "";
-    if (!with) with = "";
-    len_rep = strlen(rep);
-    len_with = strlen(with);
-
-    ins = orig;
-    for (count = 0; NULL != (tmp = strstr(ins, rep)); ++count) {
-        ins = tmp + len_rep;
-    }
-
-    /* first time through the loop, all the variable are set correctly
-     from here on,
-     tmp points to the end of the result string
-     ins points to the next occurrence of rep in orig
-     orig points to the remainder of orig after "end of rep"
-     */
-    tmp = result = (char*) cron_malloc(strlen(orig) + (len_with - len_rep) * count + 1);
-    if (!result) return NULL;
-
-    while (count--) {
-        ins = strstr(orig, rep);
-        len_front = ins - orig;
-        tmp = strncpy(tmp, orig, len_front) + len_front;
-        tmp = strcpy(tmp, with) + len_with;
-        orig += len_front + len_rep; /* move to next "end of rep" */
-    }
-    strcpy(tmp, orig);
-    return result;
-}
-
-static unsigned int parse_uint(const char* str, int* errcode) {
-    char* endptr;
-    errno = 0;
-    long int l = strtol(str, &endptr, 0);
-    if (errno == ERANGE || *endptr != '\0' || l < 0 || l > INT_MAX) {
-        *errcode = 1;
-        return 0;
-    } else {
-        *errcode = 0;
-        return (unsigned int) l;
-    }
-}
-
-static char** split_str(const char* str, char del, size_t* len_out) {
-    size_t i;
-    size_t stlen = 0;
-    size_t len = 0;
-    int accum = 0;
-    char* buf = NULL;
-    char** res = NULL;
-    size_t bi = 0;
-    size_t ri = 0;
-    char* tmp;
-
-    if (!str) goto return_error;
-    for (i = 0; '\0' != str[i]; i++) {
-        stlen += 1;
-        if (stlen >= CRON_MAX_STR_LEN_TO_SPLIT) goto return_error;
-    }
-    
-    for (i = 0; i < stlen; i++) {
-        int c = str[i];
-        if (del == str[i]) {
-            if (accum > 0) {
-                len += 1;
-                accum = 0;
-            }
-        } else if (!isspace(c)) {
-            accum += 1;
-        }
-    }
-    /* tail */
-    if (accum > 0) {
-        len += 1;
-    }
-    if (0 == len) return NULL;
-
-    buf = (char*) cron_malloc(stlen + 1);
-    if (!buf) goto return_error;
-    memset(buf, 0, stlen + 1);
-    res = (char**) cron_malloc(len * sizeof(char*));
-    if (!res) goto return_error;
-    memset(res, 0, len * sizeof(char*));
-
-    for (i = 0; i < stlen; i++) {
-        int c = str[i];
-        if (del == str[i]) {
-            if (bi > 0) {
-                tmp = strdupl(buf, bi);
-                if (!tmp) goto return_error;
-                res[ri++] = tmp;
-                memset(buf, 0, stlen + 1);
-                bi = 0;
-            }
-        } else if (!isspace(c)) {
-            buf[bi++] = str[i];
-        }
-    }
-    /* tail */
-    if (bi > 0) {
-        tmp = strdupl(buf, bi);
-        if (!tmp) goto return_error;
-        res[ri++] = tmp;
-    }
-    cron_free(buf);
-    *len_out = len;
-    return res;
-
-    return_error:
-    if (buf) {
-        cron_free(buf);
-    }
-    free_splitted(res, len);
-    *len_out = 0;
-    return NULL;
-}
-
-static char* replace_ordinals(char* value, const char* const * arr, size_t arr_len) {
-    size_t i;
-    char* cur = value;
-    char* res = NULL;
-    int first = 1;
-    for (i = 0; i < arr_len; i++) {
-        char* strnum = to_string((int) i);
-        if (!strnum) {
-            if (!first) {
-                cron_free(cur);
+/**
+ * Parses a number or, if the field accepts them, a case insensitive name.
+ */
+static unsigned int parse_value(cron_parser* parser, cron_slice str, int* errcode) {
+    unsigned int i;
+    if (parser->names && CRON_NAME_LEN == str.end - str.begin) {
+        for (i = 0; i < parser->names_len; i++) {
+            const char* name = parser->names[i];
+            if (!name) continue;
+            if (toupper((unsigned char) str.begin[0]) == name[0] &&
+                    toupper((unsigned char) str.begin[1]) == name[1] &&
+                    toupper((unsigned char) str.begin[2]) == name[2]) {
+                *errcode = 0;
+                return i;
             }
-            return NULL;
-        }
-        res = str_replace(cur, arr[i], strnum);
-        cron_free(strnum);
-        if (!first) {
-            cron_free(cur);
-        }
-        if (!res) {
-            return NULL;
-        }
-        cur = res;
-        if (first) {
-            first = 0;
         }
     }
-    return res;
-}
-
-static int has_char(char* str, char ch) {
-    size_t i;
-    size_t len = 0;
-    if (!str) return 0;
-    len = strlen(str);
-    for (i = 0; i < len; i++) {
-        if (str[i] == ch) return 1;
-    }
-    return 0;
+    return parse_uint(str, errcode);
 }
 
-static unsigned int* get_range(char* field, unsigned int min, unsigned int max, const char** error) {
-
-    char** parts = NULL;
-    size_t len = 0;
-    unsigned int* res = (unsigned int*) cron_malloc(2 * sizeof(unsigned int));
-    if (!res) goto return_error;
+static int get_range(cron_parser* parser, cron_slice field, unsigned int min, unsigned int max, unsigned int* res) {
+    const char* dash;
+    int err = 0;
 
-    res[0] = 0;
-    res[1] = 0;
-    if (1 == strlen(field) && '*' == field[0]) {
+    if (slice_is(field, '*')) {
         res[0] = min;
         res[1] = max - 1;
-    } else if (!has_char(field, '-')) {
-        int err = 0;
-        unsigned int val = parse_uint(field, &err);
+        return 0;
+    }
+
+    dash = find_char(field, '-');
+    if (!dash) {
+        res[0] = parse_value(parser, field, &err);
         if (err) {
-            *error = "Unsigned integer parse error 1";
-            goto return_error;
+            parser_error(parser, field.begin, "Unsigned integer parse error 1");
+            return 1;
         }
-
-        res[0] = val;
-        res[1] = val;
+        res[1] = res[0];
     } else {
-        parts = split_str(field, '-', &len);
-        if (2 != len) {
-            *error = "Specified range requires two fields";
-            goto return_error;
+        cron_slice from = { field.begin, dash };
+        cron_slice to = { dash + 1, field.end };
+        if (from.begin == from.end || to.begin == to.end || find_char(to, '-')) {
+            parser_error(parser, field.begin, "Specified range requires two fields");
+            return 1;
         }
-        int err = 0;
-        res[0] = parse_uint(parts[0], &err);
+        res[0] = parse_value(parser, from, &err);
         if (err) {
-            *error = "Unsigned integer parse error 2";
-            goto return_error;
+            parser_error(parser, from.begin, "Unsigned integer parse error 2");
+            return 1;
         }
-        res[1] = parse_uint(parts[1], &err);
+        res[1] = parse_value(parser, to, &err);
         if (err) {
-            *error = "Unsigned integer parse error 3";
-            goto return_error;
+            parser_error(parser, to.begin, "Unsigned integer parse error 3");
+            return 1;
         }
     }
     if (res[0] >= max || res[1] >= max) {
-        *error = "Specified range exceeds maximum";
-        goto return_error;
+        parser_error(parser, field.begin, "Specified range exceeds maximum");
+        return 1;
     }
     if (res[0] < min || res[1] < min) {
-        *error = "Specified range is less than minimum";
-        goto return_error;
+        parser_error(parser, field.begin, "Specified range is less than minimum");
+        return 1;
     }
     if (res[0] > res[1]) {
-        *error = "Specified range start exceeds range end";
-        goto return_error;
+        parser_error(parser, field.begin, "Specified range start exceeds range end");
+        return 1;
     }
+    return 0;
+}
 
-    free_splitted(parts, len);
-    *error = NULL;
-    return res;
+/**
+ * Gets the range of an H token: H(from-to) or, for H alone, the field.
+ */
+static int get_hash_range(cron_parser* parser, cron_slice field, unsigned int min, unsigned int max, unsigned int* res) {
+    cron_slice inner = { field.begin + 2, field.end - 1 };
 
-    return_error:
-    free_splitted(parts, len);
-    if (res) {
-        cron_free(res);
+    if (1 == field.end - field.begin) {
+        res[0] = min;
+        res[1] = (parser->hash_max ? parser->hash_max : max) - 1;
+        return 0;
     }
-
-    return NULL;
+    if (field.end - field.begin < 4 || '(' != field.begin[1] || ')' != field.end[-1] || !find_char(inner, '-')) {
+        parser_error(parser, field.begin, "Hash must be H or H(from-to)");
+        return 1;
+    }
+    return get_range(parser, inner, min, max, res);
 }
 
-static void set_number_hits(const char* value, uint8_t* target, unsigned int min, unsigned int max, const char** error) {
-    size_t i;
+static void set_number_hits(cron_parser* parser, cron_slice value, uint8_t* target, unsigned int min, unsigned int max) {
     unsigned int i1;
-    size_t len = 0;
-
-    char** fields = split_str(value, ',', &len);
-    if (!fields) {
-        *error = "Comma split error";
-        goto return_result;
-    }
-
-    for (i = 0; i < len; i++) {
-        if (!has_char(fields[i], '/')) {
+    unsigned int range[2];
+    unsigned int delta;
+    unsigned int span;
+    int found = 0;
+    int err = 0;
+    cron_slice field;
+    const char* comma;
+
+    for (field.begin = value.begin; field.begin < value.end; field.begin = field.end + 1) {
+        comma = find_char((cron_slice) { field.begin, value.end }, ',');
+        field.end = comma ? comma : value.end;
+        if (field.begin == field.end) continue;
+        found = 1;
+
+        const char* slash = find_char(field, '/');
+        if (!slash && 'H' == field.begin[0]) {
+            /* a single value of the range chosen by the seed */
+            if (get_hash_range(parser, field, min, max, range)) return;
+            cron_set_bit(target, range[0] + (unsigned int) (parser->hash % (range[1] - range[0] + 1)));
+            continue;
+        }
+        if (!slash) {
             /* Not an incrementer so it must be a range (possibly empty) */
-
-            unsigned int* range = get_range(fields[i], min, max, error);
-
-            if (*error) {
-                if (range) {
-                    cron_free(range);
-                }
-                goto return_result;
-
-            }
-
+            if (get_range(parser, field, min, max, range)) return;
             for (i1 = range[0]; i1 <= range[1]; i1++) {
                 cron_set_bit(target, i1);
-
             }
-            cron_free(range);
+            continue;
+        }
 
+        cron_slice from = { field.begin, slash };
+        cron_slice step = { slash + 1, field.end };
+        if (from.begin == from.end || step.begin == step.end || find_char(step, '/')) {
+            parser_error(parser, field.begin, "Incrementer must have two fields");
+            return;
+        }
+        if ('H' == from.begin[0]) {
+            if (get_hash_range(parser, from, min, max, range)) return;
         } else {
-            size_t len2 = 0;
-            char** split = split_str(fields[i], '/', &len2);
-            if (2 != len2) {
-                *error = "Incrementer must have two fields";
-                free_splitted(split, len2);
-                goto return_result;
-            }
-            unsigned int* range = get_range(split[0], min, max, error);
-            if (*error) {
-                if (range) {
-                    cron_free(range);
-                }
-                free_splitted(split, len2);
-                goto return_result;
-            }
-            if (!has_char(split[0], '-')) {
+            if (get_range(parser, from, min, max, range)) return;
+            if (!find_char(from, '-')) {
                 range[1] = max - 1;
             }
-            int err = 0;
-            unsigned int delta = parse_uint(split[1], &err);
-            if (err) {
-                *error = "Unsigned integer parse error 4";
-                cron_free(range);
-                free_splitted(split, len2);
-                goto return_result;
-            }
-            if (0 == delta) {
-                *error = "Incrementer may not be zero";
-                cron_free(range);
-                free_splitted(split, len2);
-                goto return_result;
-            }
-            for (i1 = range[0]; i1 <= range[1]; i1 += delta) {
-                cron_set_bit(target, i1);
-            }
-            free_splitted(split, len2);
-            cron_free(range);
-
+        }
+        delta = parse_uint(step, &err);
+        if (err) {
+            parser_error(parser, step.begin, "Unsigned integer parse error 4");
+            return;
+        }
+        if (0 == delta) {
+            parser_error(parser, step.begin, "Incrementer may not be zero");
+            return;
+        }
+        if ('H' == from.begin[0]) {
+            /* start at an offset within the first step chosen by the seed */
+            span = range[1] - range[0] + 1;
+            range[0] += (unsigned int) (parser->hash % (delta < span ? delta : span));
+        }
+        for (i1 = range[0]; i1 <= range[1]; i1 += delta) {
+            cron_set_bit(target, i1);
         }
     }
-    goto return_result;
-
-    return_result:
-    free_splitted(fields, len);
 
+    if (!found) {
+        parser_error(parser, value.begin, "Comma split error");
+    }
 }
 
-static void set_months(char* value, uint8_t* targ, const char** error) {
+static void set_months(cron_parser* parser, cron_slice value, uint8_t* targ) {
     unsigned int i;
     unsigned int max = 12;
 
-    char* replaced = NULL;
-
-    to_upper(value);
-    replaced = replace_ordinals(value, MONTHS_ARR, CRON_MONTHS_ARR_LEN);
-    if (!replaced) {
-        *error = "Invalid month format";
-        return;
-    }
-    set_number_hits(replaced, targ, 1, max + 1, error);
-    cron_free(replaced);
+    parser->names = MONTHS_ARR;
+    parser->names_len = CRON_MONTHS_ARR_LEN;
+    set_number_hits(parser, value, targ, 1, max + 1);
+    parser->names = NULL;
 
     /* ... and then rotate it to the front of the months */
     for (i = 1; i <= max; i++) {
@@ -842,21 +1320,20 @@ static void set_months(char* value, uint8_t* targ, const char** error) {
     }
 }
 
-static void set_days_of_week(char* field, uint8_t* targ, const char** error) {
+static void set_days_of_week(cron_parser* parser, cron_slice field, uint8_t* targ) {
     unsigned int max = 7;
-    char* replaced = NULL;
 
-    if (1 == strlen(field) && '?' == field[0]) {
-        field[0] = '*';
-    }
-    to_upper(field);
-    replaced = replace_ordinals(field, DAYS_ARR, CRON_DAYS_ARR_LEN);
-    if (!replaced) {
-        *error = "Invalid day format";
-        return;
-    }
-    set_number_hits(replaced, targ, 0, max + 1, error);
-    cron_free(replaced);
+    if (slice_is(field, '?')) {
+        field.begin = "*";
+        field.end = field.begin + 1;
+    }
+    parser->names = DAYS_ARR;
+    parser->names_len = CRON_DAYS_ARR_LEN;
+    /* H does not choose Sunday twice */
+    parser->hash_max = max;
+    set_number_hits(parser, field, targ, 0, max + 1);
+    parser->names = NULL;
+    parser->hash_max = 0;
     if (cron_get_bit(targ, 7)) {
         /* Sunday can be represented as 0 or 7*/
         cron_set_bit(targ, 0);
@@ -864,52 +1341,162 @@ static void set_days_of_week(char* field, uint8_t* targ, const char** error) {
     }
 }
 
-static void set_days_of_month(char* field, uint8_t* targ, const char** error) {
+static void set_days_of_month(cron_parser* parser, cron_slice field, uint8_t* targ) {
     /* Days of month start with 1 (in Cron and Calendar) so add one */
-    if (1 == strlen(field) && '?' == field[0]) {
-        field[0] = '*';
+    if (slice_is(field, '?')) {
+        field.begin = "*";
+        field.end = field.begin + 1;
+    }
+    /* H runs every month: only days found in all months */
+    parser->hash_max = 29;
+    set_number_hits(parser, field, targ, 1, CRON_MAX_DAYS_OF_MONTH);
+    parser->hash_max = 0;
+}
+
+/**
+ * Checks that a day of month of the expression occurs in one of its
+ * months, counting February 29.
+ */
+static int has_possible_day(cron_expr* target) {
+    int mon;
+    int day;
+
+    for (mon = 0; mon < CRON_MAX_MONTHS; mon++) {
+        if (!cron_get_bit(target->months, mon)) continue;
+        for (day = 1; day <= DAYS_IN_MONTH[mon] + (1 == mon); day++) {
+            if (cron_get_bit(target->days_of_month, day)) return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Splits the expression on whitespace into at most CRON_FIELDS_LEN fields,
+ * returns the number of fields found or -1 if there are too many.
+ */
+static int split_fields(const char* expression, cron_slice* fields, const char** extra) {
+    const char* c = expression;
+    int len = 0;
+
+    for (;;) {
+        while (isspace((unsigned char) *c)) c++;
+        if ('\0' == *c) return len;
+        if (CRON_FIELDS_LEN == len) {
+            *extra = c;
+            return -1;
+        }
+        fields[len].begin = c;
+        while ('\0' != *c && !isspace((unsigned char) *c)) c++;
+        fields[len].end = c;
+        len++;
     }
-    set_number_hits(field, targ, 1, CRON_MAX_DAYS_OF_MONTH, error);
 }
 
 void cron_parse_expr(const char* expression, cron_expr* target, const char** error) {
+    cron_parse_expr_offset(expression, target, error, NULL);
+}
+
+void cron_parse_expr_offset(const char* expression, cron_expr* target, const char** error, int* error_offset) {
     const char* err_local;
+    cron_parser parser;
+    cron_slice fields[CRON_FIELDS_LEN];
+    const char* extra = NULL;
     size_t len = 0;
-    char** fields = NULL;
+    int n;
+
     if (!error) {
         error = &err_local;
     }
-    *error = NULL;
+    memset(&parser, 0, sizeof(parser));
     if (!expression) {
         *error = "Invalid NULL expression";
-        goto return_res;
+        if (error_offset) *error_offset = 0;
+        return;
+    }
+    memset(target, 0, sizeof(cron_expr));
+
+    while ('\0' != expression[len]) {
+        if (++len >= CRON_MAX_STR_LEN_TO_SPLIT) {
+            parser_error(&parser, expression + len, "Expression exceeds maximum length");
+            goto return_res;
+        }
     }
 
-    fields = split_str(expression, ' ', &len);
-    if (len != 6) {
-        *error = "Invalid number of fields, expression must consist of 6 fields";
+    n = split_fields(expression, fields, &extra);
+    if (n != CRON_FIELDS_LEN) {
+        parser_error(&parser, extra ? extra : expression + len, "Invalid number of fields, expression must consist of 6 fields");
+        goto return_res;
+    }
+    parser.hash = hash_field(0);
+    set_number_hits(&parser, fields[0], target->seconds, 0, 60);
+    if (parser.error) goto return_res;
+    parser.hash = hash_field(1);
+    set_number_hits(&parser, fields[1], target->minutes, 0, 60);
+    if (parser.error) goto return_res;
+    parser.hash = hash_field(2);
+    set_number_hits(&parser, fields[2], target->hours, 0, 24);
+    if (parser.error) goto return_res;
+    parser.hash = hash_field(3);
+    set_days_of_month(&parser, fields[3], target->days_of_month);
+    if (parser.error) goto return_res;
+    parser.hash = hash_field(4);
+    set_months(&parser, fields[4], target->months);
+    if (parser.error) goto return_res;
+    parser.hash = hash_field(5);
+    set_days_of_week(&parser, fields[5], target->days_of_week);
+    if (parser.error) goto return_res;
+    if (!has_possible_day(target)) {
+        parser_error(&parser, fields[3].begin, "Day of month never occurs in the months specified");
         goto return_res;
     }
-    set_number_hits(fields[0], target->seconds, 0, 60, error);
-    if (*error) goto return_res;
-    set_number_hits(fields[1], target->minutes, 0, 60, error);
-    if (*error) goto return_res;
-    set_number_hits(fields[2], target->hours, 0, 24, error);
-    if (*error) goto return_res;
-    set_days_of_month(fields[3], target->days_of_month, error);
-    if (*error) goto return_res;
-    set_months(fields[4], target->months, error);
-    if (*error) goto return_res;
-    set_days_of_week(fields[5], target->days_of_week, error);
-    if (*error) goto return_res;
 
     goto return_res;
 
-    return_res: 
-    free_splitted(fields, len);
+    return_res:
+    *error = parser.error;
+    if (error_offset) {
+        *error_offset = parser.error ? (int) (parser.error_at - expression) : -1;
+    }
+}
+
+#endif /* CRON_DISABLE_PARSER */
+
+/**
+ * Finds the first local time matching the expression after 'from',
+ * both in seconds since 1970-01-01 00:00:00 local time.
+ */
+static int civil_next(const cron_compiled* expr, int64_t from, int64_t* out) {
+    cron_cal calval;
+    cron_cal* calendar = &calval;
+    if (is_periodic(expr, from)) {
+        *out = period_next(expr, from);
+        return 0;
+    }
+    cal_from_seconds(calendar, from);
+
+    int res = do_next(expr, calendar);
+    if (0 != res) return res;
+
+    if (cal_seconds(calendar) == from) {
+        /* We arrived at the original timestamp - round up to the next whole second and try again... */
+        res = add_to_field(calendar, CRON_CF_SECOND, 1);
+        if (0 != res) return res;
+        res = do_next(expr, calendar);
+        if (0 != res) return res;
+    }
+
+    *out = cal_seconds(calendar);
+    return 0;
+}
+
+time_t cron_next(const cron_expr* expr, time_t date) {
+    cron_compiled compiled;
+    if (!expr) return CRON_INVALID_INSTANT;
+    cron_compile(expr, &compiled);
+    return cron_next_compiled(&compiled, date);
 }
 
-time_t cron_next(cron_expr* expr, time_t date) {
+time_t cron_next_compiled(const cron_compiled* expr, time_t date) {
     /*
      The plan:
 
@@ -929,84 +1516,78 @@ time_t cron_next(cron_expr* expr, time_t date) {
      ...
      */
     if (!expr) return CRON_INVALID_INSTANT;
-    struct tm calval;
-    memset(&calval, 0, sizeof(struct tm));
-    struct tm* calendar = cron_time(&date, &calval);
-    if (!calendar) return CRON_INVALID_INSTANT;
-    time_t original = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == original) return CRON_INVALID_INSTANT;
-
-    int res = do_next(expr, calendar, calendar->tm_year);
-    if (0 != res) return CRON_INVALID_INSTANT;
-
-    time_t calculated = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == calculated) return CRON_INVALID_INSTANT;
-    if (calculated == original) {
-        /* We arrived at the original timestamp - round up to the next whole second and try again... */
-        res = add_to_field(calendar, CRON_CF_SECOND, 1);
-        if (0 != res) return CRON_INVALID_INSTANT;
-        res = do_next(expr, calendar, calendar->tm_year);
-        if (0 != res) return CRON_INVALID_INSTANT;
+    int64_t from = date;
+    int64_t civil = 0;
+    int64_t lo;
+    int i;
+    cron_tz_segment seg;
+
+    /* search the local time of each span with a constant UTC offset */
+    for (i = 0; i < CRON_MAX_SEGMENTS; i++) {
+        tz_segment(from + 1, &seg);
+        if (0 == i && from + 1 == seg.start && seg.prev_offset < seg.offset && CRON_DST_GAP_SHIFT == cron_dst_gap) {
+            /* the search starts at the change: local times skipped by it run now */
+            if (0 != civil_next(expr, seg.start + seg.prev_offset - 1, &civil)) return CRON_INVALID_INSTANT;
+            if (civil < seg.start + seg.offset) return seconds_to_time(seg.start);
+        }
+        lo = from + seg.offset;
+        if (CRON_TZ_NONE != seg.start && seg.prev_offset > seg.offset && CRON_DST_FOLD_ONCE == cron_dst_fold) {
+            /* local times repeated after the clock was set back already ran */
+            if (lo < seg.start + seg.prev_offset - 1) lo = seg.start + seg.prev_offset - 1;
+        }
+        if (0 != civil_next(expr, lo, &civil)) return CRON_INVALID_INSTANT;
+        if (CRON_TZ_NONE == seg.end || civil < seg.end + seg.offset) {
+            return seconds_to_time(civil - seg.offset);
+        }
+        if (seg.next_offset > seg.offset && civil < seg.end + seg.next_offset && CRON_DST_GAP_SHIFT == cron_dst_gap) {
+            /* local time skipped when the clock was set forward: run at the change */
+            return seconds_to_time(seg.end);
+        }
+        from = seg.end - 1;
     }
-
-    return cron_mktime(calendar);
+    return CRON_INVALID_INSTANT;
 }
 
 
 /* https://github.com/staticlibs/ccronexpr/pull/8 */
 
-static unsigned int prev_set_bit(uint8_t* bits, int from_index, int to_index, int* notfound) {
-    int i;
-    if (!bits) {
-        *notfound = 1;
-        return 0;
-    }
-    for (i = from_index; i >= to_index; i--) {
-        if (cron_get_bit(bits, i)) return i;
-    }
+static unsigned int prev_set_bit(uint64_t bits, int from_index, int to_index, int* notfound) {
+    if (from_index < to_index || from_index > 63) goto return_notfound;
+    bits &= CRON_BITS(from_index + 1) & (~(uint64_t) 0 << to_index);
+    if (!bits) goto return_notfound;
+    return 63 - cron_clz64(bits);
+
+    return_notfound:
     *notfound = 1;
     return 0;
 }
 
-static int last_day_of_month(int month, int year) {
-    struct tm cal;
-    time_t t;
-    memset(&cal,0,sizeof(cal));
-    cal.tm_sec=0;
-    cal.tm_min=0;
-    cal.tm_hour=0;
-    cal.tm_mon = month+1;
-    cal.tm_mday = 0;
-    cal.tm_year=year;
-    t=mktime(&cal);
-    return gmtime(&t)->tm_mday;
-}
-
 /**
  * Reset the calendar setting all the fields provided to zero.
  */
-static int reset_max(struct tm* calendar, int field) {
+static int reset_max(cron_cal* calendar, int field) {
     if (!calendar || -1 == field) {
         return 1;
     }
+    /* times of day in range leave the date unchanged: no need to normalize */
     switch (field) {
     case CRON_CF_SECOND:
-        calendar->tm_sec = 59;
-        break;
+        calendar->sec = 59;
+        return 0;
     case CRON_CF_MINUTE:
-        calendar->tm_min = 59;
-        break;
+        calendar->min = 59;
+        return 0;
     case CRON_CF_HOUR_OF_DAY:
-        calendar->tm_hour = 23;
-        break;
+        calendar->hour = 23;
+        return 0;
     case CRON_CF_DAY_OF_WEEK:
-        calendar->tm_wday = 6;
+        calendar->wday = 6;
         break;
     case CRON_CF_DAY_OF_MONTH:
-        calendar->tm_mday = last_day_of_month(calendar->tm_mon, calendar->tm_year);
+        calendar->mday = days_in_month(calendar->year, calendar->mon);
         break;
     case CRON_CF_MONTH:
-        calendar->tm_mon = 11;
+        calendar->mon = 11;
         break;
     case CRON_CF_YEAR:
         /* I don't think this is supposed to happen ... */
@@ -1015,22 +1596,18 @@ static int reset_max(struct tm* calendar, int field) {
     default:
         return 1; /* unknown field */
     }
-    time_t res = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == res) {
-        return 1;
-    }
-    return 0;
+    return cal_normalize(calendar);
 }
 
-static int reset_all_max(struct tm* calendar, int* fields) {
+static int reset_all_max(cron_cal* calendar, unsigned int fields) {
     int i;
     int res = 0;
-    if (!calendar || !fields) {
+    if (!calendar) {
         return 1;
     }
     for (i = 0; i < CRON_CF_ARR_LEN; i++) {
-        if (-1 != fields[i]) {
-            res = reset_max(calendar, fields[i]);
+        if (fields & CRON_CF_BIT(i)) {
+            res = reset_max(calendar, i);
             if (0 != res) return res;
         }
     }
@@ -1041,7 +1618,7 @@ static int reset_all_max(struct tm* calendar, int* fields) {
  * Search the bits provided for the next set bit after the value provided,
  * and reset the calendar.
  */
-static unsigned int find_prev(uint8_t* bits, unsigned int max, unsigned int value, struct tm* calendar, unsigned int field, unsigned int nextField, int* lower_orders, int* res_out) {
+static unsigned int find_prev(uint64_t bits, unsigned int max, unsigned int value, cron_cal* calendar, unsigned int field, unsigned int nextField, unsigned int lower_orders, int* res_out) {
     int notfound = 0;
     int err = 0;
     unsigned int next_value = prev_set_bit(bits, value, 0, &notfound);
@@ -1067,116 +1644,114 @@ static unsigned int find_prev(uint8_t* bits, unsigned int max, unsigned int valu
     return 0;
 }
 
-static unsigned int find_prev_day(struct tm* calendar, uint8_t* days_of_month, unsigned int day_of_month, uint8_t* days_of_week, unsigned int day_of_week, int* resets, int* res_out) {
-    int err;
-    unsigned int count = 0;
-    unsigned int max = 366;
-    while ((!cron_get_bit(days_of_month, day_of_month) || !cron_get_bit(days_of_week, day_of_week)) && count++ < max) {
-        err = add_to_field(calendar, CRON_CF_DAY_OF_MONTH, -1);
+/**
+ * Moves the calendar to the last day up to its date matching the days of
+ * month, days of week and months, like find_next_day.
+ */
+static void find_prev_day(cron_cal* calendar, const cron_compiled* expr, unsigned int resets, int* res_out) {
+    int64_t year = calendar->year;
+    int mon = calendar->mon;
+    int to = calendar->mday;
+    uint32_t days;
+    int i;
 
-        if (err) goto return_error;
-        day_of_month = calendar->tm_mday;
-        day_of_week = calendar->tm_wday;
-        reset_all_max(calendar, resets);
+    for (i = 0; i <= 12 * CRON_MAX_YEARS_DIFF; i++) {
+        days = CRON_HAS_BIT(expr->months, mon) ? month_days(expr, year, mon) & (uint32_t) CRON_BITS(to + 1) : 0;
+        if (days) {
+            if (year != calendar->year || mon != calendar->mon || (int) (63 - cron_clz64(days)) != calendar->mday) {
+                calendar->year = (int) year;
+                calendar->mon = mon;
+                calendar->mday = (int) (63 - cron_clz64(days));
+                if (0 != cal_normalize(calendar) || 0 != reset_all_max(calendar, resets)) goto return_error;
+            }
+            return;
+        }
+        to = 31;
+        if (0 == mon--) {
+            mon = 11;
+            year--;
+        }
     }
-    return day_of_month;
+    *res_out = -1;
+    return;
 
     return_error:
     *res_out = 1;
-    return 0;
 }
 
-static int do_prev(cron_expr* expr, struct tm* calendar, unsigned int dot) {
+static int do_prev(const cron_compiled* expr, cron_cal* calendar) {
     int i;
     int res = 0;
-    int* resets = NULL;
-    int* empty_list = NULL;
-    unsigned int second = 0;
-    unsigned int update_second = 0;
+    unsigned int resets;
     unsigned int minute = 0;
     unsigned int update_minute = 0;
     unsigned int hour = 0;
     unsigned int update_hour = 0;
-    unsigned int day_of_week = 0;
-    unsigned int day_of_month = 0;
-    unsigned int update_day_of_month = 0;
-    unsigned int month = 0;
-    unsigned int update_month = 0;
-
-    resets = (int*) cron_malloc(CRON_CF_ARR_LEN * sizeof(int));
-    if (!resets) goto return_result;
-    empty_list = (int*) cron_malloc(CRON_CF_ARR_LEN * sizeof(int));
-    if (!empty_list) goto return_result;
-    for (i = 0; i < CRON_CF_ARR_LEN; i++) {
-        resets[i] = -1;
-        empty_list[i] = -1;
-    }
-
-    second = calendar->tm_sec;
-    update_second = find_prev(expr->seconds, CRON_MAX_SECONDS, second, calendar, CRON_CF_SECOND, CRON_CF_MINUTE, empty_list, &res);
-    if (0 != res) goto return_result;
-    if (second == update_second) {
-        push_to_fields_arr(resets, CRON_CF_SECOND);
+    int64_t day = 0;
+
+    /* start over from the seconds whenever a higher order field changes */
+    for (i = 0; i < CRON_MAX_ITERATIONS; i++) {
+        find_prev(expr->seconds, CRON_MAX_SECONDS, calendar->sec, calendar, CRON_CF_SECOND, CRON_CF_MINUTE, 0, &res);
+        if (0 != res) return res;
+        resets = CRON_CF_BIT(CRON_CF_SECOND);
+
+        minute = calendar->min;
+        update_minute = find_prev(expr->minutes, CRON_MAX_MINUTES, minute, calendar, CRON_CF_MINUTE, CRON_CF_HOUR_OF_DAY, resets, &res);
+        if (0 != res) return res;
+        if (minute != update_minute) continue;
+        resets |= CRON_CF_BIT(CRON_CF_MINUTE);
+
+        hour = calendar->hour;
+        update_hour = find_prev(expr->hours, CRON_MAX_HOURS, hour, calendar, CRON_CF_HOUR_OF_DAY, CRON_CF_DAY_OF_WEEK, resets, &res);
+        if (0 != res) return res;
+        if (hour != update_hour) continue;
+        resets |= CRON_CF_BIT(CRON_CF_HOUR_OF_DAY);
+
+        day = calendar->days;
+        find_prev_day(calendar, expr, resets, &res);
+        if (0 != res) return res;
+        if (day != calendar->days) continue;
+        return 0;
     }
+    return -1;
+}
 
-    minute = calendar->tm_min;
-    update_minute = find_prev(expr->minutes, CRON_MAX_MINUTES, minute, calendar, CRON_CF_MINUTE, CRON_CF_HOUR_OF_DAY, resets, &res);
-    if (0 != res) goto return_result;
-    if (minute == update_minute) {
-        push_to_fields_arr(resets, CRON_CF_MINUTE);
-    } else {
-        res = do_prev(expr, calendar, dot);
-        if (0 != res) goto return_result;
+/**
+ * Finds the last local time matching the expression before 'from'.
+ */
+static int civil_prev(const cron_compiled* expr, int64_t from, int64_t* out) {
+    cron_cal calval;
+    cron_cal* calendar = &calval;
+    if (is_periodic(expr, from)) {
+        *out = period_prev(expr, from);
+        return 0;
     }
+    cal_from_seconds(calendar, from);
 
-    hour = calendar->tm_hour;
-    update_hour = find_prev(expr->hours, CRON_MAX_HOURS, hour, calendar, CRON_CF_HOUR_OF_DAY, CRON_CF_DAY_OF_WEEK, resets, &res);
-    if (0 != res) goto return_result;
-    if (hour == update_hour) {
-        push_to_fields_arr(resets, CRON_CF_HOUR_OF_DAY);
-    } else {
-        res = do_prev(expr, calendar, dot);
-        if (0 != res) goto return_result;
-    }
+    /* calculate the previous occurrence */
+    int res = do_prev(expr, calendar);
+    if (0 != res) return res;
 
-    day_of_week = calendar->tm_wday;
-    day_of_month = calendar->tm_mday;
-    update_day_of_month = find_prev_day(calendar, expr->days_of_month, day_of_month, expr->days_of_week, day_of_week, resets, &res);
-    if (0 != res) goto return_result;
-    if (day_of_month == update_day_of_month) {
-        push_to_fields_arr(resets, CRON_CF_DAY_OF_MONTH);
-    } else {
-        res = do_prev(expr, calendar, dot);
-        if (0 != res) goto return_result;
+    /* check for a match, try from the next second if one wasn't found */
+    if (cal_seconds(calendar) == from) {
+        res = add_to_field(calendar, CRON_CF_SECOND, -1);
+        if (0 != res) return res;
+        res = do_prev(expr, calendar);
+        if (0 != res) return res;
     }
 
-    month = calendar->tm_mon; /*day already adds one if no day in same month is found*/
-    update_month = find_prev(expr->months, CRON_MAX_MONTHS, month, calendar, CRON_CF_MONTH, CRON_CF_YEAR, resets, &res);
-    if (0 != res) goto return_result;
-    if (month != update_month) {
-        if (dot - calendar->tm_year > CRON_MAX_YEARS_DIFF) {
-            res = -1;
-            goto return_result;
-        }
-        res = do_prev(expr, calendar, dot);
-        if (0 != res) goto return_result;
-    }
-    goto return_result;
+    *out = cal_seconds(calendar);
+    return 0;
+}
 
-    return_result:
-    if (!resets || !empty_list) {
-        res = -1;
-    }
-    if (resets) {
-        cron_free(resets);
-    }
-    if (empty_list) {
-        cron_free(empty_list);
-    }
-    return res;
+time_t cron_prev(const cron_expr* expr, time_t date) {
+    cron_compiled compiled;
+    if (!expr) return CRON_INVALID_INSTANT;
+    cron_compile(expr, &compiled);
+    return cron_prev_compiled(&compiled, date);
 }
 
-time_t cron_prev(cron_expr* expr, time_t date) {
+time_t cron_prev_compiled(const cron_compiled* expr, time_t date) {
     /*
      The plan:
 
@@ -1196,27 +1771,1363 @@ time_t cron_prev(cron_expr* expr, time_t date) {
      ...
      */
     if (!expr) return CRON_INVALID_INSTANT;
-    struct tm calval;
-    memset(&calval, 0, sizeof(struct tm));
-    struct tm* calendar = cron_time(&date, &calval);
-    if (!calendar) return CRON_INVALID_INSTANT;
-    time_t original = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == original) return CRON_INVALID_INSTANT;
+    int64_t to = date;
+    int64_t civil = 0;
+    int64_t lo;
+    int i;
+    cron_tz_segment seg;
 
-    /* calculate the previous occurrence */
-    int res = do_prev(expr, calendar, calendar->tm_year);
-    if (0 != res) return CRON_INVALID_INSTANT;
+    for (i = 0; i < CRON_MAX_SEGMENTS; i++) {
+        tz_segment(to - 1, &seg);
+        if (0 != civil_prev(expr, to + seg.offset, &civil)) return CRON_INVALID_INSTANT;
+        if (CRON_TZ_NONE == seg.start) {
+            return seconds_to_time(civil - seg.offset);
+        }
+        lo = seg.start + seg.offset;
+        if (seg.prev_offset > seg.offset && CRON_DST_FOLD_ONCE == cron_dst_fold) {
+            /* local times repeated after the clock was set back ran before it */
+            lo = seg.start + seg.prev_offset;
+        }
+        if (civil >= lo) {
+            return seconds_to_time(civil - seg.offset);
+        }
+        if (seg.prev_offset < seg.offset && civil >= seg.start + seg.prev_offset && CRON_DST_GAP_SHIFT == cron_dst_gap) {
+            /* local time skipped when the clock was set forward: run at the change */
+            return seconds_to_time(seg.start);
+        }
+        to = seg.start;
+    }
+    return CRON_INVALID_INSTANT;
+}
 
-    /* check for a match, try from the next second if one wasn't found */
-    time_t calculated = cron_mktime(calendar);
-    if (CRON_INVALID_INSTANT == calculated) return CRON_INVALID_INSTANT;
-    if (calculated == original) {
-        /* We arrived at the original timestamp - round up to the next whole second and try again... */
-        res = add_to_field(calendar, CRON_CF_SECOND, -1);
-        if (0 != res) return CRON_INVALID_INSTANT;
-        res = do_prev(expr, calendar, calendar->tm_year);
-        if (0 != res) return CRON_INVALID_INSTANT;
+static int match_fields(const cron_compiled* expr, const cron_cal* cal) {
+    return (int) (CRON_HAS_BIT(expr->seconds, cal->sec) & CRON_HAS_BIT(expr->minutes, cal->min) &
+            CRON_HAS_BIT(expr->hours, cal->hour) & CRON_HAS_BIT(expr->days_of_month, cal->mday) &
+            CRON_HAS_BIT(expr->months, cal->mon) & CRON_HAS_BIT(expr->days_of_week, cal->wday));
+}
+
+/**
+ * Applies the daylight saving time policy to a date in the segment:
+ * returns 0 or 1 if the policy decides, -1 if the fields decide.
+ */
+static int match_policy(const cron_compiled* expr, const cron_tz_segment* seg, int64_t date) {
+    int64_t civil = 0;
+    if (CRON_TZ_NONE == seg->start) return -1;
+    if (seg->prev_offset > seg->offset && CRON_DST_FOLD_ONCE == cron_dst_fold &&
+            date < seg->start + seg->prev_offset - seg->offset) {
+        /* repeated local time, run before the clock was set back */
+        return 0;
+    }
+    if (date == seg->start && seg->prev_offset < seg->offset && CRON_DST_GAP_SHIFT == cron_dst_gap) {
+        /* local times skipped when the clock was set forward run at the change */
+        if (0 == civil_next(expr, seg->start + seg->prev_offset - 1, &civil) && civil < seg->start + seg->offset) return 1;
+    }
+    return -1;
+}
+
+int cron_match(const cron_expr* expr, time_t date) {
+    cron_compiled compiled;
+    if (!expr) return 0;
+    cron_compile(expr, &compiled);
+    return cron_match_compiled(&compiled, date);
+}
+
+int cron_match_compiled(const cron_compiled* expr, time_t date) {
+    cron_tz_segment seg;
+    cron_cal cal;
+    int res;
+    if (!expr) return 0;
+
+    tz_segment(date, &seg);
+    res = match_policy(expr, &seg, date);
+    if (-1 != res) return res;
+    cal_from_seconds(&cal, (int64_t) date + seg.offset);
+    return match_fields(expr, &cal);
+}
+
+#define CRON_MATCH_BLOCK 64
+
+/**
+ * State kept between the dates of a batch: the UTC offset span of the
+ * last date and whether its local day matches.
+ */
+typedef struct {
+    int64_t start; /* dates in [start, end) have the offset */
+    int64_t end;
+    int64_t repeated; /* dates before are repeated local times */
+    int64_t change; /* date of a change run by the gap policy */
+    int32_t offset;
+    int64_t midnight; /* local seconds at the start of the last day */
+    uint64_t day_match; /* 0 or ~0 */
+} cron_match_state;
+
+static void match_sync(cron_match_state* state, int64_t date) {
+    cron_tz_segment seg;
+    tz_segment(date, &seg);
+    state->offset = seg.offset;
+    state->start = CRON_TZ_NONE == seg.start ? INT64_MIN : seg.start;
+    state->end = CRON_TZ_NONE == seg.end ? INT64_MAX : seg.end;
+    state->repeated = INT64_MIN;
+    state->change = INT64_MIN;
+    if (CRON_TZ_NONE == seg.start) return;
+    if (seg.prev_offset > seg.offset && CRON_DST_FOLD_ONCE == cron_dst_fold) {
+        state->repeated = seg.start + seg.prev_offset - seg.offset;
+    }
+    if (seg.prev_offset < seg.offset && CRON_DST_GAP_SHIFT == cron_dst_gap) {
+        state->change = seg.start;
+    }
+}
+
+/**
+ * Matches up to CRON_MATCH_BLOCK dates. The dates are split into local
+ * days and seconds of the day one at a time, reusing the span and day of
+ * the previous date without dividing when they are the same; the time of
+ * day is then tested for the whole block in a loop without branches,
+ * which compilers can vectorize.
+ */
+static uint64_t match_block(const cron_compiled* expr, const time_t* dates, size_t n, cron_match_state* state) {
+    uint32_t sod[CRON_MATCH_BLOCK];
+    uint64_t day_match[CRON_MATCH_BLOCK];
+    uint64_t change = 0;
+    uint64_t word = 0;
+    cron_cal cal;
+    int64_t local;
+    int64_t day;
+    int64_t t;
+    uint32_t s;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        t = dates[i];
+        if (t < state->start || t >= state->end) {
+            match_sync(state, t);
+        }
+        local = t + state->offset;
+        if ((uint64_t) local - (uint64_t) state->midnight >= 86400) {
+            day = floor_div(local, 86400);
+            civil_from_days(day, &cal);
+            state->midnight = day * 86400;
+            state->day_match = (uint64_t) 0 - (CRON_HAS_BIT(expr->days_of_month, cal.mday) &
+                    CRON_HAS_BIT(expr->months, cal.mon) & CRON_HAS_BIT(expr->days_of_week, cal.wday));
+        }
+        sod[i] = (uint32_t) (local - state->midnight);
+        day_match[i] = t < state->repeated ? 0 : state->day_match;
+        if (t == state->change) change |= (uint64_t) 1 << i;
+    }
+
+    for (i = 0; i < n; i++) {
+        s = sod[i];
+        word |= ((expr->seconds >> (s % 60)) & (expr->minutes >> (s / 60 % 60)) &
+                ((uint64_t) expr->hours >> (s / 3600)) & day_match[i] & 1) << i;
+    }
+
+    while (change) {
+        i = cron_ctz64(change);
+        change &= change - 1;
+        if (cron_match_compiled(expr, dates[i])) word |= (uint64_t) 1 << i;
+    }
+    return word;
+}
+
+int64_t cron_match_batch(const cron_expr* expr, const time_t* dates, size_t n, uint64_t* out) {
+    cron_compiled compiled;
+    cron_match_state state;
+    size_t i;
+    int64_t matched = 0;
+    if (!expr || (n > 0 && (!dates || !out))) return -1;
+
+    cron_compile(expr, &compiled);
+    memset(&state, 0, sizeof(cron_match_state));
+    state.start = INT64_MAX;
+    state.end = INT64_MIN;
+    state.midnight = INT64_MIN;
+    for (i = 0; i < n; i += CRON_MATCH_BLOCK) {
+        out[i / 64] = match_block(&compiled, dates + i, n - i < CRON_MATCH_BLOCK ? n - i : CRON_MATCH_BLOCK, &state);
+        matched += cron_popcount64(out[i / 64]);
+    }
+    return matched;
+}
+
+/* days of month with the same remainder modulo 7 */
+static const uint32_t CRON_WEEK_DAYS[7] = {
+    0x10204081U, 0x20408102U, 0x40810204U, 0x81020408U, 0x02040810U, 0x04081020U, 0x08102040U
+};
+
+/* days since 1970-01-01 in a 400 year cycle of the calendar, 20871 weeks */
+#define CRON_CYCLE_DAYS 146097
+
+/**
+ * Counts the times of day before the second of the day, 0-86400,
+ * matching the second, minute and hour fields.
+ */
+static int64_t count_tod(const cron_compiled* expr, int64_t sod) {
+    int hour = (int) (sod / 3600);
+    int min = (int) (sod / 60 % 60);
+    int sec = (int) (sod % 60);
+    int64_t secs = cron_popcount64(expr->seconds);
+    int64_t n = cron_popcount64(expr->hours & CRON_BITS(hour)) * cron_popcount64(expr->minutes) * secs;
+
+    if (hour < CRON_MAX_HOURS && CRON_HAS_BIT(expr->hours, hour)) {
+        n += cron_popcount64(expr->minutes & CRON_BITS(min)) * secs;
+        if (CRON_HAS_BIT(expr->minutes, min)) n += cron_popcount64(expr->seconds & CRON_BITS(sec));
+    }
+    return n;
+}
+
+/**
+ * Counts the days in [from, to] matching the month, day of month and day
+ * of week fields, a month at a time.
+ */
+static int64_t count_months(const cron_compiled* expr, int64_t from, int64_t to) {
+    cron_cal cal;
+    int64_t n = 0;
+    int64_t last;
+    uint32_t days;
+    int w;
+
+    while (from <= to) {
+        civil_from_days(from, &cal);
+        last = from + days_in_month(cal.year, cal.mon) - cal.mday;
+        if (last > to) last = to;
+        if (CRON_HAS_BIT(expr->months, cal.mon)) {
+            days = expr->days_of_month & (uint32_t) (CRON_BITS(cal.mday + (last - from) + 1) & ~CRON_BITS(cal.mday));
+            for (w = 0; w < CRON_MAX_DAYS_OF_WEEK - 1 && days; w++) {
+                if (!CRON_HAS_BIT(expr->days_of_week, w)) continue;
+                n += cron_popcount64(days & CRON_WEEK_DAYS[(cal.mday + w - cal.wday + 7) % 7]);
+            }
+        }
+        from = last + 1;
+    }
+    return n;
+}
+
+/**
+ * Counts the days in [from, to] matching the date fields, skipping whole
+ * 400 year cycles of the calendar.
+ */
+static int64_t count_days(const cron_compiled* expr, int64_t from, int64_t to) {
+    int64_t cycles;
+
+    if (from > to) return 0;
+    cycles = (to - from + 1) / CRON_CYCLE_DAYS;
+    if (cycles < 2) return count_months(expr, from, to);
+    return cycles * count_months(expr, from, from + CRON_CYCLE_DAYS - 1) +
+            count_months(expr, from + cycles * CRON_CYCLE_DAYS, to);
+}
+
+/**
+ * Counts the local times in [from, to] matching the expression.
+ */
+static int64_t count_civil(const cron_compiled* expr, int64_t from, int64_t to) {
+    int64_t first = floor_div(from, 86400);
+    int64_t last = floor_div(to, 86400);
+    int64_t day = count_tod(expr, 86400);
+
+    if (from > to || 0 == day) return 0;
+    if (first == last) {
+        return count_days(expr, first, first) * (count_tod(expr, to - last * 86400 + 1) - count_tod(expr, from - first * 86400));
+    }
+    return count_days(expr, first, first) * (day - count_tod(expr, from - first * 86400)) +
+            count_days(expr, first + 1, last - 1) * day +
+            count_days(expr, last, last) * count_tod(expr, to - last * 86400 + 1);
+}
+
+int64_t cron_count(const cron_expr* expr, time_t from, time_t to) {
+    cron_compiled compiled;
+    if (!expr) return -1;
+    cron_compile(expr, &compiled);
+    return cron_count_compiled(&compiled, from, to);
+}
+
+int64_t cron_count_compiled(const cron_compiled* expr, time_t from, time_t to) {
+    int64_t limit = days_from_civil(CRON_MAX_YEAR, 0, 1) * 86400;
+    int64_t t = (int64_t) from + 1;
+    int64_t n = 0;
+    int64_t lo;
+    int64_t hi;
+    cron_tz_segment seg;
+
+    if (!expr || from < -limit || to > limit) return -1;
+
+    /* count the local times of each span with a constant UTC offset */
+    while (t <= to) {
+        tz_segment(t, &seg);
+        lo = t;
+        hi = CRON_TZ_NONE == seg.end || seg.end > to ? to : seg.end - 1;
+        if (CRON_TZ_NONE != seg.start && seg.prev_offset > seg.offset && CRON_DST_FOLD_ONCE == cron_dst_fold) {
+            /* local times repeated after the clock was set back already ran */
+            if (lo < seg.start + seg.prev_offset - seg.offset) lo = seg.start + seg.prev_offset - seg.offset;
+        }
+        if (t == seg.start && seg.prev_offset < seg.offset && CRON_DST_GAP_SHIFT == cron_dst_gap) {
+            /* local times skipped when the clock was set forward run at the change */
+            n += cron_match_compiled(expr, (time_t) t);
+            lo = t + 1;
+        }
+        n += count_civil(expr, lo + seg.offset, hi + seg.offset);
+        t = hi + 1;
+    }
+    return n;
+}
+
+/**
+ * Expressions of a histogram with the same fields, and with the same
+ * time fields.
+ */
+typedef struct {
+    cron_compiled* exprs; /* unique expressions */
+    int64_t* count; /* number of each unique expression */
+    uint32_t* tod; /* time fields group of each unique expression */
+    cron_compiled* tods; /* first expression of each time fields group */
+    int64_t* weight; /* expressions of each group running on a day */
+    int64_t* bins; /* runs in each second or minute of a day */
+    uint32_t len;
+    uint32_t tod_len;
+} cron_histogram_state;
+
+static uint64_t histogram_hash(const cron_compiled* expr, int date) {
+    uint64_t h = expr->seconds * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ expr->minutes) * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ expr->hours) * 0x9e3779b97f4a7c15ULL;
+    if (date) {
+        h = (h ^ expr->days_of_month) * 0x9e3779b97f4a7c15ULL;
+        h = (h ^ ((uint64_t) expr->months << 8 | expr->days_of_week)) * 0x9e3779b97f4a7c15ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+static int histogram_same(const cron_compiled* a, const cron_compiled* b, int date) {
+    if (a->seconds != b->seconds || a->minutes != b->minutes || a->hours != b->hours) return 0;
+    return !date || (a->days_of_month == b->days_of_month && a->months == b->months && a->days_of_week == b->days_of_week);
+}
+
+/**
+ * Groups the expressions using an open addressing table of indexes.
+ */
+static int histogram_group(cron_histogram_state* state, const cron_expr* exprs, size_t n) {
+    cron_compiled compiled;
+    uint32_t* slots = NULL;
+    uint32_t* tod_slots = NULL;
+    size_t size = 16;
+    size_t i;
+    size_t j;
+
+    while (size < 2 * n) size *= 2;
+    slots = (uint32_t*) cron_malloc(size * sizeof(uint32_t));
+    if (!slots) goto return_error;
+    tod_slots = (uint32_t*) cron_malloc(size * sizeof(uint32_t));
+    if (!tod_slots) goto return_error;
+    memset(slots, 0xff, size * sizeof(uint32_t));
+    memset(tod_slots, 0xff, size * sizeof(uint32_t));
+
+    for (i = 0; i < n; i++) {
+        cron_compile(&exprs[i], &compiled);
+        for (j = histogram_hash(&compiled, 1) & (size - 1); UINT32_MAX != slots[j]; j = (j + 1) & (size - 1)) {
+            if (histogram_same(&state->exprs[slots[j]], &compiled, 1)) break;
+        }
+        if (UINT32_MAX != slots[j]) {
+            state->count[slots[j]]++;
+            continue;
+        }
+        slots[j] = state->len;
+        state->exprs[state->len] = compiled;
+        state->count[state->len] = 1;
+
+        for (j = histogram_hash(&compiled, 0) & (size - 1); UINT32_MAX != tod_slots[j]; j = (j + 1) & (size - 1)) {
+            if (histogram_same(&state->tods[tod_slots[j]], &compiled, 0)) break;
+        }
+        if (UINT32_MAX == tod_slots[j]) {
+            tod_slots[j] = state->tod_len;
+            state->tods[state->tod_len++] = compiled;
+        }
+        state->tod[state->len++] = tod_slots[j];
+    }
+
+    cron_free(slots);
+    cron_free(tod_slots);
+    return 0;
+
+    return_error:
+    if (slots) cron_free(slots);
+    return 1;
+}
+
+/**
+ * Adds up the runs of each second (res 1) or minute (res 60) of the
+ * local day, from the time fields of the expressions running on the day.
+ */
+static void histogram_day(cron_histogram_state* state, int64_t day, int res) {
+    const cron_compiled* expr;
+    cron_cal cal;
+    int64_t w;
+    uint32_t i;
+    int h, m, sec;
+
+    civil_from_days(day, &cal);
+    memset(state->weight, 0, state->tod_len * sizeof(int64_t));
+    memset(state->bins, 0, (size_t) (86400 / res) * sizeof(int64_t));
+    for (i = 0; i < state->len; i++) {
+        expr = &state->exprs[i];
+        if (CRON_HAS_BIT(expr->days_of_month, cal.mday) & CRON_HAS_BIT(expr->months, cal.mon) &
+                CRON_HAS_BIT(expr->days_of_week, cal.wday)) {
+            state->weight[state->tod[i]] += state->count[i];
+        }
+    }
+
+    for (i = 0; i < state->tod_len; i++) {
+        if (0 == state->weight[i]) continue;
+        expr = &state->tods[i];
+        w = state->weight[i];
+        if (60 == res) w *= cron_popcount64(expr->seconds);
+        for (h = 0; h < CRON_MAX_HOURS; h++) {
+            if (!CRON_HAS_BIT(expr->hours, h)) continue;
+            for (m = 0; m < CRON_MAX_MINUTES; m++) {
+                if (!CRON_HAS_BIT(expr->minutes, m)) continue;
+                if (60 == res) {
+                    state->bins[h * 60 + m] += w;
+                    continue;
+                }
+                for (sec = 0; sec < CRON_MAX_SECONDS; sec++) {
+                    if (CRON_HAS_BIT(expr->seconds, sec)) state->bins[h * 3600 + m * 60 + sec] += w;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Adds the runs of the local days in the UTC range [lo, hi) with the
+ * offset to the buckets. The range is aligned to the resolution.
+ */
+static void histogram_span(cron_histogram_state* state, int64_t lo, int64_t hi, int32_t offset, int res,
+        int64_t from, int64_t bucket, int64_t* counts) {
+    int64_t day;
+    int64_t first;
+    int64_t last;
+    int64_t midnight;
+    int64_t j;
+
+    for (day = floor_div(lo + offset, 86400); day * 86400 < hi + offset; day++) {
+        midnight = day * 86400 - offset;
+        first = lo > midnight ? (lo - midnight) / res : 0;
+        last = hi < midnight + 86400 ? (hi - midnight) / res : 86400 / res;
+        histogram_day(state, day, res);
+        for (j = first; j < last; j++) {
+            if (state->bins[j]) counts[(midnight + j * res - from) / bucket] += state->bins[j];
+        }
+    }
+}
+
+static void histogram_free(cron_histogram_state* state) {
+    if (state->exprs) cron_free(state->exprs);
+    if (state->count) cron_free(state->count);
+    if (state->tod) cron_free(state->tod);
+    if (state->tods) cron_free(state->tods);
+    if (state->weight) cron_free(state->weight);
+    if (state->bins) cron_free(state->bins);
+}
+
+int cron_histogram(const cron_expr* exprs, size_t n, time_t from, time_t bucket, size_t buckets, int64_t* counts) {
+    cron_histogram_state state;
+    cron_tz_segment seg;
+    int64_t limit = days_from_civil(CRON_MAX_YEAR, 0, 1) * 86400;
+    int64_t end;
+    int64_t t;
+    int64_t lo;
+    int64_t hi;
+    int64_t first;
+    uint32_t i;
+    int res = 60;
+
+    if ((n > 0 && !exprs) || !counts || bucket <= 0 || n >= UINT32_MAX) return -1;
+    if (from < -limit || from > limit || buckets > (uint64_t) (limit - from) / (uint64_t) bucket) return -1;
+    end = (int64_t) from + (int64_t) buckets * bucket;
+    memset(counts, 0, buckets * sizeof(int64_t));
+
+    /* minutes are added up when the buckets and the changes of UTC offset
+     * are on whole minutes, seconds otherwise */
+    if (0 != bucket % 60 || 0 != from % 60) res = 1;
+    for (t = from; t < end && 60 == res; t = seg.end) {
+        tz_segment(t, &seg);
+        if (0 != seg.offset % 60 || 0 != seg.prev_offset % 60 || (CRON_TZ_NONE != seg.start && 0 != seg.start % 60)) res = 1;
+        if (CRON_TZ_NONE == seg.end) break;
+    }
+
+    memset(&state, 0, sizeof(cron_histogram_state));
+    if (n > 0) {
+        state.exprs = (cron_compiled*) cron_malloc(n * sizeof(cron_compiled));
+        state.count = (int64_t*) cron_malloc(n * sizeof(int64_t));
+        state.tod = (uint32_t*) cron_malloc(n * sizeof(uint32_t));
+        state.tods = (cron_compiled*) cron_malloc(n * sizeof(cron_compiled));
+        state.weight = (int64_t*) cron_malloc(n * sizeof(int64_t));
+        state.bins = (int64_t*) cron_malloc((size_t) (86400 / res) * sizeof(int64_t));
+        if (!state.exprs || !state.count || !state.tod || !state.tods || !state.weight || !state.bins) goto return_error;
+        if (0 != histogram_group(&state, exprs, n)) goto return_error;
+    }
+
+    /* add the local days of each span with a constant UTC offset */
+    for (t = from; t < end && n > 0; t = hi) {
+        tz_segment(t, &seg);
+        lo = t;
+        hi = CRON_TZ_NONE == seg.end || seg.end > end ? end : seg.end;
+        if (CRON_TZ_NONE != seg.start && seg.prev_offset > seg.offset && CRON_DST_FOLD_ONCE == cron_dst_fold) {
+            /* local times repeated after the clock was set back already ran */
+            first = seg.start + seg.prev_offset - seg.offset;
+            if (lo < first) lo = first < hi ? first : hi;
+        }
+        if (t == seg.start && seg.prev_offset < seg.offset && CRON_DST_GAP_SHIFT == cron_dst_gap) {
+            /* local times skipped when the clock was set forward run at the
+             * change: count the first second or minute of each expression */
+            first = lo + res < hi ? lo + res : hi;
+            for (i = 0; i < state.len; i++) {
+                counts[(lo - from) / bucket] += state.count[i] * cron_count_compiled(&state.exprs[i], (time_t) (lo - 1), (time_t) (first - 1));
+            }
+            lo = first;
+        }
+        histogram_span(&state, lo, hi, seg.offset, res, from, bucket, counts);
+    }
+
+    histogram_free(&state);
+    return 0;
+
+    return_error:
+    histogram_free(&state);
+    return -1;
+}
+
+/**
+ * Moves the iterator to the date, converting it to local time once for
+ * the whole span with the same UTC offset.
+ */
+static void iter_sync(cron_iter* iter, time_t date) {
+    cron_tz_segment seg;
+    tz_segment(date, &seg);
+    iter->date = date;
+    iter->offset = seg.offset;
+    iter->start = seg.start;
+    if (CRON_TZ_NONE != seg.start && seg.prev_offset > seg.offset && CRON_DST_FOLD_ONCE == cron_dst_fold) {
+        /* repeated local times are left to cron_next/cron_prev */
+        iter->start = seg.start + seg.prev_offset - seg.offset;
+    }
+    iter->end = CRON_TZ_NONE == seg.end ? INT64_MAX : seg.end;
+    cal_from_seconds(&iter->cal, (int64_t) date + seg.offset);
+}
+
+void cron_iter_init(cron_iter* iter, const cron_expr* expr, time_t date) {
+    if (!iter || !expr) return;
+    cron_compile(expr, &iter->expr);
+    iter_sync(iter, date);
+}
+
+time_t cron_iter_next(cron_iter* iter) {
+    cron_cal cal;
+    int64_t t;
+    time_t next;
+    if (!iter) return CRON_INVALID_INSTANT;
+
+    /* step the local time while the search stays in the span */
+    if ((int64_t) iter->date + 1 >= iter->start && (int64_t) iter->date + 1 < iter->end && iter->expr.period) {
+        /* the local time is not kept: periodic expressions never step it */
+        if (is_periodic(&iter->expr, (int64_t) iter->date + iter->offset)) {
+            t = period_next(&iter->expr, (int64_t) iter->date + iter->offset) - iter->offset;
+            if (t < iter->end) {
+                next = seconds_to_time(t);
+                if (CRON_INVALID_INSTANT != next) iter->date = next;
+                return next;
+            }
+        }
+    } else if ((int64_t) iter->date + 1 >= iter->start && (int64_t) iter->date + 1 < iter->end) {
+        cal = iter->cal;
+        if (0 == add_to_field(&cal, CRON_CF_SECOND, 1) && 0 == do_next(&iter->expr, &cal)) {
+            t = cal_seconds(&cal) - iter->offset;
+            if (t < iter->end) {
+                next = seconds_to_time(t);
+                if (CRON_INVALID_INSTANT == next) return next;
+                iter->cal = cal;
+                iter->date = next;
+                return next;
+            }
+        }
+    }
+
+    next = cron_next_compiled(&iter->expr, iter->date);
+    if (CRON_INVALID_INSTANT != next) iter_sync(iter, next);
+    return next;
+}
+
+time_t cron_iter_prev(cron_iter* iter) {
+    cron_cal cal;
+    int64_t t;
+    time_t prev;
+    if (!iter) return CRON_INVALID_INSTANT;
+
+    /* step the local time while the search stays in the span */
+    if ((int64_t) iter->date - 1 >= iter->start && (int64_t) iter->date - 1 < iter->end && iter->expr.period) {
+        if (is_periodic(&iter->expr, (int64_t) iter->date + iter->offset)) {
+            t = period_prev(&iter->expr, (int64_t) iter->date + iter->offset) - iter->offset;
+            if (t >= iter->start) {
+                prev = seconds_to_time(t);
+                if (CRON_INVALID_INSTANT != prev) iter->date = prev;
+                return prev;
+            }
+        }
+    } else if ((int64_t) iter->date - 1 >= iter->start && (int64_t) iter->date - 1 < iter->end) {
+        cal = iter->cal;
+        if (0 == add_to_field(&cal, CRON_CF_SECOND, -1) && 0 == do_prev(&iter->expr, &cal)) {
+            t = cal_seconds(&cal) - iter->offset;
+            if (t >= iter->start) {
+                prev = seconds_to_time(t);
+                if (CRON_INVALID_INSTANT == prev) return prev;
+                iter->cal = cal;
+                iter->date = prev;
+                return prev;
+            }
+        }
+    }
+
+    prev = cron_prev_compiled(&iter->expr, iter->date);
+    if (CRON_INVALID_INSTANT != prev) iter_sync(iter, prev);
+    return prev;
+}
+
+void cron_sched_init(cron_sched* sched) {
+    if (!sched) return;
+    memset(sched, 0, sizeof(cron_sched));
+}
+
+static int sched_before(const cron_sched_entry* a, const cron_sched_entry* b) {
+    return a->next < b->next || (a->next == b->next && a->id < b->id);
+}
+
+static void sched_up(cron_sched_entry* heap, uint32_t i) {
+    cron_sched_entry e = heap[i];
+    uint32_t parent;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!sched_before(&e, &heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = e;
+}
+
+static void sched_down(cron_sched_entry* heap, uint32_t len, uint32_t i) {
+    cron_sched_entry e = heap[i];
+    uint32_t child;
+    while ((child = 2 * i + 1) < len) {
+        if (child + 1 < len && sched_before(&heap[child + 1], &heap[child])) child++;
+        if (!sched_before(&heap[child], &e)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = e;
+}
+
+static int sched_grow(cron_sched* sched) {
+    uint32_t cap = sched->cap ? sched->cap * 2 : 64;
+    cron_compiled* exprs = NULL;
+    cron_sched_entry* heap = NULL;
+
+    if (cap <= sched->cap) return 1;
+    exprs = (cron_compiled*) cron_malloc(cap * sizeof(cron_compiled));
+    if (!exprs) goto return_error;
+    heap = (cron_sched_entry*) cron_malloc(cap * sizeof(cron_sched_entry));
+    if (!heap) goto return_error;
+
+    if (sched->len > 0) {
+        memcpy(exprs, sched->exprs, sched->len * sizeof(cron_compiled));
+        memcpy(heap, sched->heap, sched->heap_len * sizeof(cron_sched_entry));
+    }
+    if (sched->exprs && !sched->shared) cron_free(sched->exprs);
+    if (sched->heap) cron_free(sched->heap);
+    sched->exprs = exprs;
+    sched->heap = heap;
+    sched->cap = cap;
+    sched->shared = 0;
+    return 0;
+
+    return_error:
+    if (exprs) cron_free(exprs);
+    return 1;
+}
+
+int64_t cron_sched_add(cron_sched* sched, const cron_expr* expr, time_t date) {
+    uint32_t id;
+    time_t next;
+    if (!sched || !expr) return -1;
+    if (sched->len == sched->cap && 0 != sched_grow(sched)) return -1;
+
+    id = sched->len++;
+    cron_compile(expr, &sched->exprs[id]);
+    next = cron_next_compiled(&sched->exprs[id], date);
+    if (CRON_INVALID_INSTANT != next) {
+        sched->heap[sched->heap_len].next = next;
+        sched->heap[sched->heap_len].id = id;
+        sched_up(sched->heap, sched->heap_len++);
+    }
+    return id;
+}
+
+int cron_sched_load(cron_sched* sched, const cron_compiled* exprs, uint32_t n, time_t date) {
+    if (!sched) return -1;
+    memset(sched, 0, sizeof(cron_sched));
+    if (0 == n) return 0;
+    if (!exprs) return -1;
+
+    sched->heap = (cron_sched_entry*) cron_malloc(n * sizeof(cron_sched_entry));
+    if (!sched->heap) return -1;
+    /* not written to: copied by sched_grow before adding */
+    sched->exprs = (cron_compiled*) exprs;
+    sched->len = n;
+    sched->cap = n;
+    sched->shared = 1;
+    cron_sched_reset(sched, date);
+    return 0;
+}
+
+time_t cron_sched_next(const cron_sched* sched) {
+    if (!sched || 0 == sched->heap_len) return CRON_INVALID_INSTANT;
+    return sched->heap[0].next;
+}
+
+int cron_sched_pop(cron_sched* sched, time_t date, uint32_t* id, time_t* fire) {
+    cron_sched_entry* top;
+    time_t next;
+    if (!sched || 0 == sched->heap_len || sched->heap[0].next > date) return 0;
+
+    top = &sched->heap[0];
+    if (id) *id = top->id;
+    if (fire) *fire = top->next;
+
+    next = cron_next_compiled(&sched->exprs[top->id], date);
+    if (CRON_INVALID_INSTANT == next) {
+        /* no longer scheduled */
+        *top = sched->heap[--sched->heap_len];
+    } else {
+        top->next = next;
+    }
+    if (sched->heap_len > 0) sched_down(sched->heap, sched->heap_len, 0);
+    return 1;
+}
+
+void cron_sched_reset(cron_sched* sched, time_t date) {
+    uint32_t id;
+    uint32_t i;
+    time_t next;
+    if (!sched) return;
+
+    sched->heap_len = 0;
+    for (id = 0; id < sched->len; id++) {
+        next = cron_next_compiled(&sched->exprs[id], date);
+        if (CRON_INVALID_INSTANT == next) continue;
+        sched->heap[sched->heap_len].next = next;
+        sched->heap[sched->heap_len].id = id;
+        sched->heap_len++;
+    }
+    for (i = sched->heap_len / 2; i > 0; i--) {
+        sched_down(sched->heap, sched->heap_len, i - 1);
+    }
+}
+
+void cron_sched_free(cron_sched* sched) {
+    if (!sched) return;
+    if (sched->exprs && !sched->shared) cron_free(sched->exprs);
+    if (sched->heap) cron_free(sched->heap);
+    memset(sched, 0, sizeof(cron_sched));
+}
+
+/* first row of each field in the index: one row per value */
+#define CRON_INDEX_SECOND 0
+#define CRON_INDEX_MINUTE (CRON_INDEX_SECOND + CRON_MAX_SECONDS)
+#define CRON_INDEX_HOUR (CRON_INDEX_MINUTE + CRON_MAX_MINUTES)
+#define CRON_INDEX_DAY_OF_MONTH (CRON_INDEX_HOUR + CRON_MAX_HOURS)
+#define CRON_INDEX_MONTH (CRON_INDEX_DAY_OF_MONTH + CRON_MAX_DAYS_OF_MONTH)
+#define CRON_INDEX_DAY_OF_WEEK (CRON_INDEX_MONTH + CRON_MAX_MONTHS)
+#define CRON_INDEX_ROWS (CRON_INDEX_DAY_OF_WEEK + CRON_MAX_DAYS_OF_WEEK - 1)
+
+void cron_index_init(cron_index* index) {
+    if (!index) return;
+    memset(index, 0, sizeof(cron_index));
+}
+
+static int index_grow(cron_index* index) {
+    uint32_t words = index->words ? index->words * 2 : 1;
+    uint64_t* bits = NULL;
+    size_t row;
+
+    if (words <= index->words || (uint64_t) CRON_INDEX_ROWS * words * sizeof(uint64_t) > SIZE_MAX) return 1;
+    bits = (uint64_t*) cron_malloc((size_t) CRON_INDEX_ROWS * words * sizeof(uint64_t));
+    if (!bits) return 1;
+    memset(bits, 0, (size_t) CRON_INDEX_ROWS * words * sizeof(uint64_t));
+
+    for (row = 0; row < CRON_INDEX_ROWS && index->words > 0; row++) {
+        memcpy(bits + row * words, index->bits + row * index->words, index->words * sizeof(uint64_t));
+    }
+    if (index->bits) cron_free(index->bits);
+    index->bits = bits;
+    index->words = words;
+    return 0;
+}
+
+static void index_set(cron_index* index, unsigned int row, uint64_t values, unsigned int max, uint32_t id) {
+    unsigned int i;
+    for (i = 0; i < max; i++) {
+        if (CRON_HAS_BIT(values, i)) {
+            index->bits[(row + i) * (size_t) index->words + id / 64] |= (uint64_t) 1 << (id % 64);
+        }
+    }
+}
+
+int64_t cron_index_add(cron_index* index, const cron_expr* expr) {
+    cron_compiled compiled;
+    uint32_t id;
+    if (!index || !expr) return -1;
+    if (index->len == UINT32_MAX) return -1;
+    if (index->len == (uint64_t) index->words * 64 && 0 != index_grow(index)) return -1;
+
+    id = index->len++;
+    cron_compile(expr, &compiled);
+    index_set(index, CRON_INDEX_SECOND, compiled.seconds, CRON_MAX_SECONDS, id);
+    index_set(index, CRON_INDEX_MINUTE, compiled.minutes, CRON_MAX_MINUTES, id);
+    index_set(index, CRON_INDEX_HOUR, compiled.hours, CRON_MAX_HOURS, id);
+    index_set(index, CRON_INDEX_DAY_OF_MONTH, compiled.days_of_month, CRON_MAX_DAYS_OF_MONTH, id);
+    index_set(index, CRON_INDEX_MONTH, compiled.months, CRON_MAX_MONTHS, id);
+    index_set(index, CRON_INDEX_DAY_OF_WEEK, compiled.days_of_week, CRON_MAX_DAYS_OF_WEEK - 1, id);
+    return id;
+}
+
+size_t cron_index_words(const cron_index* index) {
+    if (!index) return 0;
+    return (index->len + 63) / 64;
+}
+
+/**
+ * ANDs the six rows selected by the local time into out, one vector at a
+ * time, then the remaining words.
+ */
+static void index_and(const uint64_t* const* rows, uint64_t* out, size_t words) {
+    size_t w = 0;
+#if defined(CRON_INDEX_AVX2)
+    __m256i v;
+    for (; w + 4 <= words; w += 4) {
+        v = _mm256_loadu_si256((const __m256i*) (rows[0] + w));
+        v = _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*) (rows[1] + w)));
+        v = _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*) (rows[2] + w)));
+        v = _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*) (rows[3] + w)));
+        v = _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*) (rows[4] + w)));
+        v = _mm256_and_si256(v, _mm256_loadu_si256((const __m256i*) (rows[5] + w)));
+        _mm256_storeu_si256((__m256i*) (out + w), v);
+    }
+#elif defined(CRON_INDEX_SSE2)
+    __m128i v;
+    for (; w + 2 <= words; w += 2) {
+        v = _mm_loadu_si128((const __m128i*) (rows[0] + w));
+        v = _mm_and_si128(v, _mm_loadu_si128((const __m128i*) (rows[1] + w)));
+        v = _mm_and_si128(v, _mm_loadu_si128((const __m128i*) (rows[2] + w)));
+        v = _mm_and_si128(v, _mm_loadu_si128((const __m128i*) (rows[3] + w)));
+        v = _mm_and_si128(v, _mm_loadu_si128((const __m128i*) (rows[4] + w)));
+        v = _mm_and_si128(v, _mm_loadu_si128((const __m128i*) (rows[5] + w)));
+        _mm_storeu_si128((__m128i*) (out + w), v);
+    }
+#elif defined(CRON_INDEX_NEON)
+    uint64x2_t v;
+    for (; w + 2 <= words; w += 2) {
+        v = vld1q_u64(rows[0] + w);
+        v = vandq_u64(v, vld1q_u64(rows[1] + w));
+        v = vandq_u64(v, vld1q_u64(rows[2] + w));
+        v = vandq_u64(v, vld1q_u64(rows[3] + w));
+        v = vandq_u64(v, vld1q_u64(rows[4] + w));
+        v = vandq_u64(v, vld1q_u64(rows[5] + w));
+        vst1q_u64(out + w, v);
+    }
+#endif
+    for (; w < words; w++) {
+        out[w] = rows[0][w] & rows[1][w] & rows[2][w] & rows[3][w] & rows[4][w] & rows[5][w];
+    }
+}
+
+int64_t cron_index_match(const cron_index* index, time_t date, uint64_t* out) {
+    const uint64_t* rows[6];
+    cron_tz_segment seg;
+    cron_cal cal;
+    size_t words;
+    size_t w;
+    int64_t n = 0;
+    if (!index || !out) return -1;
+
+    words = cron_index_words(index);
+    if (0 == words) return 0;
+
+    tz_segment(date, &seg);
+    cal_from_seconds(&cal, (int64_t) date + seg.offset);
+    rows[0] = index->bits + (size_t) (CRON_INDEX_SECOND + cal.sec) * index->words;
+    rows[1] = index->bits + (size_t) (CRON_INDEX_MINUTE + cal.min) * index->words;
+    rows[2] = index->bits + (size_t) (CRON_INDEX_HOUR + cal.hour) * index->words;
+    rows[3] = index->bits + (size_t) (CRON_INDEX_DAY_OF_MONTH + cal.mday) * index->words;
+    rows[4] = index->bits + (size_t) (CRON_INDEX_MONTH + cal.mon) * index->words;
+    rows[5] = index->bits + (size_t) (CRON_INDEX_DAY_OF_WEEK + cal.wday) * index->words;
+
+    index_and(rows, out, words);
+    for (w = 0; w < words; w++) {
+        n += cron_popcount64(out[w]);
+    }
+    return n;
+}
+
+void cron_index_free(cron_index* index) {
+    if (!index) return;
+    if (index->bits) cron_free(index->bits);
+    memset(index, 0, sizeof(cron_index));
+}
+
+#define CRON_IMAGE_BYTE_ORDER 0x01020304
+
+/* offsets of the parts of an image of n expressions */
+static size_t image_entries_offset(size_t n) {
+    return sizeof(cron_image_header) + n * sizeof(cron_compiled);
+}
+
+static size_t image_labels_offset(size_t n) {
+    return image_entries_offset(n) + n * sizeof(cron_image_entry);
+}
+
+/* a field matching no value never runs */
+static int image_never(const cron_compiled* expr) {
+    return !expr->seconds || !expr->minutes || !expr->hours || !expr->days_of_month ||
+            !expr->months || !expr->days_of_week;
+}
+
+size_t cron_image_write(const cron_expr* exprs, const char* const* labels, size_t n, void* out, size_t size) {
+    cron_image_header header;
+    cron_compiled* compiled;
+    cron_image_entry* entries;
+    char* blob;
+    uint64_t labels_size = 0;
+    uint64_t total;
+    size_t len;
+    size_t i;
+
+    if (n > UINT32_MAX / sizeof(cron_compiled)) return 0;
+    for (i = 0; i < n; i++) {
+        labels_size += (labels && labels[i] ? strlen(labels[i]) : 0) + 1;
+    }
+    if (labels_size > UINT32_MAX) return 0;
+    total = (uint64_t) image_labels_offset(n) + labels_size;
+    /* labels are padded so images can follow each other aligned */
+    total = (total + 7) & ~(uint64_t) 7;
+    if (total > UINT32_MAX || total > (size_t) -1) return 0;
+    if (!exprs || !out || size < total) return (size_t) total;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CRON_IMAGE_MAGIC, sizeof(CRON_IMAGE_MAGIC));
+    header.version = CRON_IMAGE_VERSION;
+    header.byte_order = CRON_IMAGE_BYTE_ORDER;
+    header.expr_size = sizeof(cron_compiled);
+    header.count = (uint32_t) n;
+    header.labels_size = (uint32_t) (total - image_labels_offset(n));
+    memcpy(out, &header, sizeof(header));
+
+    compiled = (cron_compiled*) ((char*) out + sizeof(cron_image_header));
+    entries = (cron_image_entry*) ((char*) out + image_entries_offset(n));
+    blob = (char*) out + image_labels_offset(n);
+    memset(blob, 0, header.labels_size);
+    labels_size = 0;
+    for (i = 0; i < n; i++) {
+        cron_compile(&exprs[i], &compiled[i]);
+        entries[i].label = (uint32_t) labels_size;
+        entries[i].flags = image_never(&compiled[i]) ? CRON_IMAGE_NEVER : 0;
+        len = labels && labels[i] ? strlen(labels[i]) : 0;
+        if (len > 0) memcpy(blob + labels_size, labels[i], len);
+        labels_size += len + 1;
+    }
+    return (size_t) total;
+}
+
+/**
+ * Checks an expression of an image is one cron_compile could have written:
+ * no bits outside of the fields, as the searches index tables by field
+ * value, and the period computed from the fields.
+ */
+static int image_valid(const cron_compiled* expr) {
+    cron_compiled check;
+
+    if (expr->seconds & ~CRON_BITS(CRON_MAX_SECONDS)) return 0;
+    if (expr->minutes & ~CRON_BITS(CRON_MAX_MINUTES)) return 0;
+    if (expr->hours & ~CRON_BITS(CRON_MAX_HOURS)) return 0;
+    if (expr->days_of_month & ~(CRON_BITS(CRON_MAX_DAYS_OF_MONTH) & ~(uint64_t) 1)) return 0;
+    if (expr->months & ~CRON_BITS(CRON_MAX_MONTHS)) return 0;
+    if (expr->days_of_week & ~CRON_BITS(CRON_MAX_DAYS_OF_WEEK - 1)) return 0;
+
+    memset(&check, 0, sizeof(check));
+    check.seconds = expr->seconds;
+    check.minutes = expr->minutes;
+    check.hours = expr->hours;
+    check.days_of_month = expr->days_of_month;
+    check.months = expr->months;
+    check.days_of_week = expr->days_of_week;
+    compile_period(&check);
+    return check.period == expr->period && check.phase == expr->phase;
+}
+
+int cron_image_open(cron_image* image, const void* data, size_t size, const char** error) {
+    const cron_image_header* header = (const cron_image_header*) data;
+    const char* err = NULL;
+    size_t n;
+    uint32_t i;
+
+    if (!image || !data) {
+        err = "Invalid NULL image";
+        goto return_res;
+    }
+    memset(image, 0, sizeof(cron_image));
+    if (0 != (uintptr_t) data % sizeof(uint64_t)) {
+        err = "Image is not 8 byte aligned";
+        goto return_res;
+    }
+    if (size < sizeof(cron_image_header) || 0 != memcmp(header->magic, CRON_IMAGE_MAGIC, sizeof(CRON_IMAGE_MAGIC))) {
+        err = "Not a schedule image";
+        goto return_res;
+    }
+    if (CRON_IMAGE_VERSION != header->version) {
+        err = "Unsupported image version";
+        goto return_res;
+    }
+    if (CRON_IMAGE_BYTE_ORDER != header->byte_order || sizeof(cron_compiled) != header->expr_size) {
+        err = "Image was written by an incompatible build";
+        goto return_res;
+    }
+    if (0 != header->reserved) {
+        err = "Invalid image header";
+        goto return_res;
     }
 
-    return cron_mktime(calendar);
+    n = header->count;
+    if (n > (size - sizeof(cron_image_header)) / (sizeof(cron_compiled) + sizeof(cron_image_entry)) ||
+            size - image_labels_offset(n) != header->labels_size) {
+        err = "Image size does not match the header";
+        goto return_res;
+    }
+    if (n > 0 && (0 == header->labels_size || '\0' != ((const char*) data)[size - 1])) {
+        err = "Invalid image labels";
+        goto return_res;
+    }
+
+    image->exprs = (const cron_compiled*) ((const char*) data + sizeof(cron_image_header));
+    image->entries = (const cron_image_entry*) ((const char*) data + image_entries_offset(n));
+    image->labels = (const char*) data + image_labels_offset(n);
+    for (i = 0; i < n; i++) {
+        if (!image_valid(&image->exprs[i])) {
+            err = "Invalid expression in image";
+            goto return_res;
+        }
+        if (image->entries[i].flags != (image_never(&image->exprs[i]) ? CRON_IMAGE_NEVER : 0)) {
+            err = "Invalid expression flags in image";
+            goto return_res;
+        }
+        if (image->entries[i].label >= header->labels_size) {
+            err = "Invalid image labels";
+            goto return_res;
+        }
+    }
+    image->len = (uint32_t) n;
+
+    return_res:
+    if (err && image) memset(image, 0, sizeof(cron_image));
+    if (error) *error = err;
+    return err ? -1 : 0;
+}
+
+const char* cron_image_label(const cron_image* image, uint32_t id) {
+    if (!image || id >= image->len) return NULL;
+    return image->labels + image->entries[id].label;
+}
+
+/* growing buffer used while building a table */
+typedef struct {
+    uint8_t* bytes;
+    size_t len;
+    size_t cap;
+} cron_table_buf;
+
+static int table_reserve(cron_table_buf* buf, size_t n) {
+    size_t cap = buf->cap ? buf->cap : 4096;
+    uint8_t* bytes;
+
+    if (buf->cap - buf->len >= n) return 0;
+    while (cap - buf->len < n) {
+        if (cap > ((size_t) -1) / 2) return 1;
+        cap *= 2;
+    }
+    bytes = (uint8_t*) cron_malloc(cap);
+    if (!bytes) return 1;
+    if (buf->len > 0) memcpy(bytes, buf->bytes, buf->len);
+    if (buf->bytes) cron_free(buf->bytes);
+    buf->bytes = bytes;
+    buf->cap = cap;
+    return 0;
+}
+
+static size_t put_varint(uint8_t* p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t) v;
+    return n;
+}
+
+static int get_varint(const uint8_t** p, const uint8_t* end, uint64_t* v) {
+    unsigned int shift = 0;
+    uint8_t byte;
+
+    *v = 0;
+    do {
+        if (*p == end || shift > 63) return 1;
+        byte = *(*p)++;
+        *v |= (uint64_t) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return 0;
+}
+
+static size_t table_blocks(uint32_t count) {
+    return ((size_t) count + CRON_TABLE_BLOCK - 1) / CRON_TABLE_BLOCK;
+}
+
+/* points the table at a serialized table */
+static void table_view(cron_table* table, const void* data, size_t size) {
+    table->header = (const cron_table_header*) data;
+    table->blocks = (const cron_table_block*) ((const char*) data + sizeof(cron_table_header));
+    table->deltas = (const uint8_t*) (table->blocks + table_blocks(table->header->count));
+    table->size = size;
+}
+
+int cron_table_build(cron_table* table, const cron_expr* expr, time_t from, time_t to) {
+    cron_iter iter;
+    cron_table_buf blocks;
+    cron_table_buf deltas;
+    cron_table_block block;
+    cron_table_header header;
+    uint8_t* mem = NULL;
+    uint64_t count = 0;
+    size_t size;
+    time_t prev = 0;
+    time_t t;
+
+    if (!table) return -1;
+    memset(table, 0, sizeof(cron_table));
+    if (!expr || to < from) return -1;
+    memset(&blocks, 0, sizeof(blocks));
+    memset(&deltas, 0, sizeof(deltas));
+
+    cron_iter_init(&iter, expr, from);
+    while (CRON_INVALID_INSTANT != (t = cron_iter_next(&iter)) && t <= to) {
+        if (UINT32_MAX == count) goto return_error;
+        if (0 == count % CRON_TABLE_BLOCK) {
+            if (deltas.len > UINT32_MAX || 0 != table_reserve(&blocks, sizeof(block))) goto return_error;
+            memset(&block, 0, sizeof(block));
+            block.first = (int64_t) t;
+            block.offset = (uint32_t) deltas.len;
+            memcpy(blocks.bytes + blocks.len, &block, sizeof(block));
+            blocks.len += sizeof(block);
+        } else {
+            if (0 != table_reserve(&deltas, 10)) goto return_error;
+            deltas.len += put_varint(deltas.bytes + deltas.len, (uint64_t) ((int64_t) t - (int64_t) prev));
+        }
+        prev = t;
+        count++;
+    }
+    if (deltas.len > UINT32_MAX) goto return_error;
+
+    /* deltas are padded so tables can follow each other aligned */
+    size = sizeof(header) + blocks.len + ((deltas.len + 7) & ~(size_t) 7);
+    mem = (uint8_t*) cron_malloc(size);
+    if (!mem) goto return_error;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CRON_TABLE_MAGIC, sizeof(CRON_TABLE_MAGIC));
+    header.version = CRON_TABLE_VERSION;
+    header.byte_order = CRON_IMAGE_BYTE_ORDER;
+    header.from = (int64_t) from;
+    header.to = (int64_t) to;
+    header.count = (uint32_t) count;
+    header.deltas_size = (uint32_t) deltas.len;
+    memset(mem, 0, size);
+    memcpy(mem, &header, sizeof(header));
+    if (blocks.len > 0) memcpy(mem + sizeof(header), blocks.bytes, blocks.len);
+    if (deltas.len > 0) memcpy(mem + sizeof(header) + blocks.len, deltas.bytes, deltas.len);
+
+    table_view(table, mem, size);
+    table->mem = mem;
+    if (blocks.bytes) cron_free(blocks.bytes);
+    if (deltas.bytes) cron_free(deltas.bytes);
+    return 0;
+
+    return_error:
+    if (blocks.bytes) cron_free(blocks.bytes);
+    if (deltas.bytes) cron_free(deltas.bytes);
+    return -1;
+}
+
+int cron_table_open(cron_table* table, const void* data, size_t size, const char** error) {
+    const cron_table_header* header = (const cron_table_header*) data;
+    const uint8_t* p;
+    const uint8_t* end;
+    const char* err = NULL;
+    uint64_t delta;
+    int64_t t;
+    int64_t last;
+    size_t nblocks;
+    size_t b;
+    uint32_t i;
+
+    if (!table || !data) {
+        err = "Invalid NULL table";
+        goto return_res;
+    }
+    memset(table, 0, sizeof(cron_table));
+    if (0 != (uintptr_t) data % sizeof(uint64_t)) {
+        err = "Table is not 8 byte aligned";
+        goto return_res;
+    }
+    if (size < sizeof(cron_table_header) || 0 != memcmp(header->magic, CRON_TABLE_MAGIC, sizeof(CRON_TABLE_MAGIC))) {
+        err = "Not a fire time table";
+        goto return_res;
+    }
+    if (CRON_TABLE_VERSION != header->version) {
+        err = "Unsupported table version";
+        goto return_res;
+    }
+    if (CRON_IMAGE_BYTE_ORDER != header->byte_order) {
+        err = "Table was written by an incompatible build";
+        goto return_res;
+    }
+    nblocks = table_blocks(header->count);
+    if (nblocks > (size - sizeof(cron_table_header)) / sizeof(cron_table_block) ||
+            size - sizeof(cron_table_header) - nblocks * sizeof(cron_table_block) != (((size_t) header->deltas_size + 7) & ~(size_t) 7)) {
+        err = "Table size does not match the header";
+        goto return_res;
+    }
+
+    /* decode every time: queries do not check the deltas again */
+    table_view(table, data, size);
+    end = table->deltas + header->deltas_size;
+    last = header->from;
+    p = table->deltas;
+    for (b = 0; b < nblocks && !err; b++) {
+        t = table->blocks[b].first;
+        if (t <= last || t > header->to || table->blocks[b].offset != (size_t) (p - table->deltas) ||
+                0 != table->blocks[b].reserved) {
+            err = "Invalid table block";
+            break;
+        }
+        for (i = 1; i < CRON_TABLE_BLOCK && b * CRON_TABLE_BLOCK + i < header->count; i++) {
+            if (0 != get_varint(&p, end, &delta) || 0 == delta || delta > (uint64_t) (header->to - t)) {
+                err = "Invalid table delta";
+                break;
+            }
+            t += (int64_t) delta;
+        }
+        last = t;
+    }
+    if (!err && p != end) err = "Invalid table delta";
+
+    return_res:
+    if (err && table) memset(table, 0, sizeof(cron_table));
+    if (error) *error = err;
+    return err ? -1 : 0;
+}
+
+size_t cron_table_write(const cron_table* table, void* out, size_t size) {
+    if (!table || !table->header) return 0;
+    if (out && size >= table->size) memcpy(out, table->header, table->size);
+    return table->size;
+}
+
+/**
+ * Finds the fire times of a table around a date: returns the number of
+ * times at or before the date and sets the last of them and the first time
+ * after the date, or INT64_MIN if there is none.
+ */
+static uint64_t table_find(const cron_table* table, int64_t date, int64_t* last, int64_t* after) {
+    const cron_table_block* blocks = table->blocks;
+    const uint8_t* end = table->deltas + table->header->deltas_size;
+    const uint8_t* p;
+    uint32_t count = table->header->count;
+    size_t nblocks = table_blocks(count);
+    size_t lo = 0;
+    size_t hi = nblocks;
+    size_t mid;
+    uint64_t delta;
+    uint32_t n;
+    uint32_t i;
+    int64_t t;
+
+    *last = INT64_MIN;
+    *after = INT64_MIN;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (blocks[mid].first <= date) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (0 == lo) {
+        if (count > 0) *after = blocks[0].first;
+        return 0;
+    }
+
+    /* decode the block of the last time at or before the date */
+    lo--;
+    n = count - (uint32_t) lo * CRON_TABLE_BLOCK;
+    if (n > CRON_TABLE_BLOCK) n = CRON_TABLE_BLOCK;
+    t = blocks[lo].first;
+    p = table->deltas + blocks[lo].offset;
+    for (i = 1; i < n; i++) {
+        (void) get_varint(&p, end, &delta);
+        if (t + (int64_t) delta > date) {
+            *after = t + (int64_t) delta;
+            break;
+        }
+        t += (int64_t) delta;
+    }
+    *last = t;
+    if (i == n && lo + 1 < nblocks) *after = blocks[lo + 1].first;
+    return (uint64_t) lo * CRON_TABLE_BLOCK + i;
+}
+
+time_t cron_table_next(const cron_table* table, time_t date) {
+    int64_t last;
+    int64_t after;
+    if (!table || !table->header) return CRON_INVALID_INSTANT;
+    if ((int64_t) date < table->header->from || (int64_t) date >= table->header->to) return CRON_INVALID_INSTANT;
+
+    (void) table_find(table, (int64_t) date, &last, &after);
+    return INT64_MIN == after ? CRON_INVALID_INSTANT : (time_t) after;
+}
+
+time_t cron_table_prev(const cron_table* table, time_t date) {
+    int64_t last;
+    int64_t after;
+    if (!table || !table->header) return CRON_INVALID_INSTANT;
+    if ((int64_t) date <= table->header->from || (int64_t) date - 1 > table->header->to) return CRON_INVALID_INSTANT;
+
+    (void) table_find(table, (int64_t) date - 1, &last, &after);
+    return INT64_MIN == last ? CRON_INVALID_INSTANT : (time_t) last;
+}
+
+int64_t cron_table_count(const cron_table* table, time_t from, time_t to) {
+    int64_t last;
+    int64_t after;
+    if (!table || !table->header) return -1;
+    if (to <= from) return 0;
+    if ((int64_t) from < table->header->from || (int64_t) to > table->header->to) return -1;
+
+    return (int64_t) (table_find(table, (int64_t) to, &last, &after) - table_find(table, (int64_t) from, &last, &after));
+}
+
+void cron_table_free(cron_table* table) {
+    if (!table) return;
+    if (table->mem) cron_free(table->mem);
+    memset(table, 0, sizeof(cron_table));
 }
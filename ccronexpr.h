@@ -48,6 +48,53 @@ typedef struct {
     uint8_t months[2];
 } cron_expr;
 
+/**
+ * Cron expression compiled to one word per field for fast searching:
+ * bit n of a field is set if the value n matches. Months are 0-11 and
+ * days of week are 0-6 (Sunday is 0). Expressions running every day at
+ * times a constant period apart, like every 5 minutes, are searched with
+ * arithmetic instead of the calendar.
+ */
+typedef struct {
+    uint64_t seconds;
+    uint64_t minutes;
+    uint32_t hours;
+    uint32_t days_of_month;
+    uint16_t months;
+    uint8_t days_of_week;
+    uint32_t period; /* seconds between local times matching, or 0 */
+    uint32_t phase; /* first local time of the day matching */
+} cron_compiled;
+
+/**
+ * Broken down local time, normalized with calendar arithmetic only.
+ */
+typedef struct {
+    int64_t days; /* days since 1970-01-01 */
+    int year;
+    int mon; /* 0-11 */
+    int mday; /* 1-31 */
+    int hour;
+    int min;
+    int sec;
+    int wday; /* 0-6, Sunday is 0 */
+} cron_cal;
+
+/**
+ * Iterator over the fire dates of an expression. The broken down local
+ * time of the last date is kept between steps, so stepping within a span
+ * of constant UTC offset does not convert from time_t again.
+ */
+typedef struct {
+    cron_compiled expr;
+    cron_cal cal; /* local time of date */
+    time_t date; /* last fire date, or the start date */
+    int64_t start; /* UTC span where cal is date plus offset: [start, end) */
+    int64_t end;
+    int32_t offset;
+} cron_iter;
+
+#ifndef CRON_DISABLE_PARSER
 /**
  * Parses specified cron expression.
  * 
@@ -61,6 +108,30 @@ typedef struct {
  */
 void cron_parse_expr(const char* expression, cron_expr* target, const char** error);
 
+/**
+ * Parses specified cron expression without allocating memory, reporting
+ * the position of the first invalid token.
+ *
+ * @param expression cron expression as nul-terminated string,
+ *        should be no longer that 256 bytes
+ * @param pointer to cron expression structure
+ * @param error output error message, will be set to string literal
+ *        error message in case of error. Will be set to NULL on success.
+ * @param error_offset output byte offset of the error into the expression,
+ *        set to -1 on success. May be NULL.
+ */
+void cron_parse_expr_offset(const char* expression, cron_expr* target, const char** error, int* error_offset);
+#endif /* CRON_DISABLE_PARSER */
+
+/**
+ * Converts a parsed cron expression to the word per field representation
+ * used by the cron_*_compiled functions.
+ *
+ * @param expr parsed cron expression
+ * @param target compiled expression
+ */
+void cron_compile(const cron_expr* expr, cron_compiled* target);
+
 /**
  * Uses the specified expression to calculate the next 'fire' date after
  * the specified date. All dates are processed as UTC (GMT) dates 
@@ -71,7 +142,12 @@ void cron_parse_expr(const char* expression, cron_expr* target, const char** err
  * @param date start date to start calculation from
  * @return next 'fire' date in case of success, '((time_t) -1)' in case of error.
  */
-time_t cron_next(cron_expr* expr, time_t date);
+time_t cron_next(const cron_expr* expr, time_t date);
+
+/**
+ * Same as 'cron_next' using a compiled expression.
+ */
+time_t cron_next_compiled(const cron_compiled* expr, time_t date);
 
 /**
  * Uses the specified expression to calculate the previous 'fire' date after
@@ -83,7 +159,502 @@ time_t cron_next(cron_expr* expr, time_t date);
  * @param date start date to start calculation from
  * @return previous 'fire' date in case of success, '((time_t) -1)' in case of error.
  */
-time_t cron_prev(cron_expr* expr, time_t date);
+time_t cron_prev(const cron_expr* expr, time_t date);
+
+/**
+ * Same as 'cron_prev' using a compiled expression.
+ */
+time_t cron_prev_compiled(const cron_compiled* expr, time_t date);
+
+/**
+ * Checks if the expression runs at the specified date, the same as
+ * 'cron_next(expr, date - 1) == date' without searching.
+ *
+ * @param expr parsed cron expression
+ * @param date date to check
+ * @return 1 if the expression runs at the date, 0 otherwise
+ */
+int cron_match(const cron_expr* expr, time_t date);
+
+/**
+ * Same as 'cron_match' using a compiled expression.
+ */
+int cron_match_compiled(const cron_compiled* expr, time_t date);
+
+/**
+ * Checks if the expression runs at each of the specified dates, like
+ * 'cron_match'. Dates in increasing order are fastest.
+ *
+ * @param expr parsed cron expression
+ * @param dates dates to check
+ * @param n number of dates
+ * @param out output bitset of (n + 63) / 64 words: bit i % 64 of word
+ *        i / 64 is set if the expression runs at dates[i]
+ * @return number of matching dates, -1 on error
+ */
+int64_t cron_match_batch(const cron_expr* expr, const time_t* dates, size_t n, uint64_t* out);
+
+/**
+ * Counts the fire dates after 'from' and at or before 'to', the number of
+ * dates 't' where 'cron_match(expr, t)' is 1, without visiting each one:
+ * the time fields give the runs per day, multiplied by the matching days
+ * of each month.
+ *
+ * @param expr parsed cron expression
+ * @param from start of the range, not included
+ * @param to end of the range, included
+ * @return number of fire dates, 0 if 'to' is not after 'from', '-1' if
+ *         the range is outside of the years -1000000 to 1000000
+ */
+int64_t cron_count(const cron_expr* expr, time_t from, time_t to);
+
+/**
+ * Same as 'cron_count' using a compiled expression.
+ */
+int64_t cron_count_compiled(const cron_compiled* expr, time_t from, time_t to);
+
+/**
+ * Adds up the fire dates of a set of expressions in fixed size buckets,
+ * from the fields of the expressions rather than from each fire date:
+ * expressions with the same fields are added once, and the runs of each
+ * local day are added up from the time fields of the expressions running
+ * on the day.
+ *
+ * @param exprs parsed cron expressions
+ * @param n number of expressions
+ * @param from start of the first bucket
+ * @param bucket seconds in a bucket. Minutes are added up when buckets
+ *        are whole minutes starting on a minute, seconds otherwise.
+ * @param buckets number of buckets
+ * @param counts output number of runs in each bucket: counts[k] is the
+ *        number of runs at or after from + k * bucket and before
+ *        from + (k + 1) * bucket
+ * @return 0 on success, -1 on error
+ */
+int cron_histogram(const cron_expr* exprs, size_t n, time_t from, time_t bucket, size_t buckets, int64_t* counts);
+
+/**
+ * Initializes an iterator over the fire dates of the expression around
+ * the specified date.
+ *
+ * @param iter iterator to initialize
+ * @param expr parsed cron expression
+ * @param date start date, not returned by the iterator
+ */
+void cron_iter_init(cron_iter* iter, const cron_expr* expr, time_t date);
+
+/**
+ * Moves the iterator to the next fire date, like 'cron_next' from the
+ * date it was at.
+ *
+ * @param iter initialized iterator
+ * @return next 'fire' date in case of success, '((time_t) -1)' in case of
+ *         error. The iterator does not move on error.
+ */
+time_t cron_iter_next(cron_iter* iter);
+
+/**
+ * Moves the iterator to the previous fire date, like 'cron_prev' from the
+ * date it was at.
+ *
+ * @param iter initialized iterator
+ * @return previous 'fire' date in case of success, '((time_t) -1)' in case
+ *         of error. The iterator does not move on error.
+ */
+time_t cron_iter_prev(cron_iter* iter);
+
+/**
+ * Pending time of a scheduler entry.
+ */
+typedef struct {
+    time_t next;
+    uint32_t id;
+} cron_sched_entry;
+
+/**
+ * Scheduler for a large number of expressions. Pending times are kept in
+ * a binary heap, so finding the next time is O(1) and running an entry
+ * is O(log n).
+ */
+typedef struct {
+    cron_compiled* exprs; /* indexed by id */
+    cron_sched_entry* heap; /* entries with a next time, earliest first */
+    uint32_t len; /* number of expressions */
+    uint32_t heap_len;
+    uint32_t cap;
+    uint32_t shared; /* exprs is not owned: see 'cron_sched_load' */
+} cron_sched;
+
+/**
+ * Initializes an empty scheduler.
+ *
+ * @param sched scheduler to initialize
+ */
+void cron_sched_init(cron_sched* sched);
+
+/**
+ * Adds an expression to the scheduler.
+ *
+ * @param sched initialized scheduler
+ * @param expr parsed cron expression
+ * @param date the expression is first scheduled after this date
+ * @return id of the expression, numbered from 0 in the order added, or
+ *         -1 if memory could not be allocated
+ */
+int64_t cron_sched_add(cron_sched* sched, const cron_expr* expr, time_t date);
+
+/**
+ * Initializes a scheduler running compiled expressions in place, for
+ * example from a 'cron_image': the expressions are not copied and must
+ * stay valid until the scheduler is freed. Only the heap is allocated.
+ * Expressions added afterwards with 'cron_sched_add' are copied with the
+ * others.
+ *
+ * @param sched scheduler to initialize
+ * @param exprs compiled expressions, ids are their indexes
+ * @param n number of expressions
+ * @param date the expressions are first scheduled after this date
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int cron_sched_load(cron_sched* sched, const cron_compiled* exprs, uint32_t n, time_t date);
+
+/**
+ * Returns the earliest time an expression is scheduled.
+ *
+ * @param sched initialized scheduler
+ * @return next 'fire' date, '((time_t) -1)' if no expression is scheduled
+ */
+time_t cron_sched_next(const cron_sched* sched);
+
+/**
+ * Removes one expression scheduled at or before the specified date and
+ * schedules it again after the date, so runs missed before the date are
+ * returned once. Expressions scheduled at the same time are returned in
+ * the order added.
+ *
+ * @param sched initialized scheduler
+ * @param date run expressions scheduled at or before this date
+ * @param id output id of the expression
+ * @param fire output time the expression was scheduled
+ * @return 1 if an expression was due, 0 otherwise
+ */
+int cron_sched_pop(cron_sched* sched, time_t date, uint32_t* id, time_t* fire);
+
+/**
+ * Schedules every expression again after the specified date, for example
+ * after the system clock was set.
+ *
+ * @param sched initialized scheduler
+ * @param date expressions are scheduled after this date
+ */
+void cron_sched_reset(cron_sched* sched, time_t date);
+
+/**
+ * Frees the memory used by the scheduler.
+ *
+ * @param sched initialized scheduler
+ */
+void cron_sched_free(cron_sched* sched);
+
+/**
+ * Inverted index over a set of expressions: for each value of each field,
+ * a bitset of the ids of the expressions matching the value. Finding the
+ * expressions matching a time is an AND of six bitsets.
+ */
+typedef struct {
+    uint64_t* bits; /* one row of 'words' words per field value */
+    uint32_t len; /* number of expressions */
+    uint32_t words; /* allocated words per row */
+} cron_index;
+
+/**
+ * Initializes an empty index.
+ *
+ * @param index index to initialize
+ */
+void cron_index_init(cron_index* index);
+
+/**
+ * Adds an expression to the index.
+ *
+ * @param index initialized index
+ * @param expr parsed cron expression
+ * @return id of the expression, numbered from 0 in the order added, or
+ *         -1 if memory could not be allocated
+ */
+int64_t cron_index_add(cron_index* index, const cron_expr* expr);
+
+/**
+ * Returns the number of words of the bitset filled in by
+ * 'cron_index_match'.
+ *
+ * @param index initialized index
+ * @return number of 64 bit words, (number of expressions + 63) / 64
+ */
+size_t cron_index_words(const cron_index* index);
+
+/**
+ * Finds the expressions matching the local time of the specified date.
+ * Only the fields are compared: an expression run at a change of UTC
+ * offset by the daylight saving time policy does not match.
+ *
+ * @param index initialized index
+ * @param date date to match
+ * @param out output bitset of 'cron_index_words' words: bit id % 64 of
+ *        word id / 64 is set if the expression matches
+ * @return number of matching expressions, -1 on error
+ */
+int64_t cron_index_match(const cron_index* index, time_t date, uint64_t* out);
+
+/**
+ * Frees the memory used by the index.
+ *
+ * @param index initialized index
+ */
+void cron_index_free(cron_index* index);
+
+#define CRON_IMAGE_MAGIC "CRONIMG"
+#define CRON_IMAGE_VERSION 1
+/* entry flag: a field of the expression matches no value, it never runs */
+#define CRON_IMAGE_NEVER 1
+
+/**
+ * Header of a schedule image: compiled expressions with labels, written
+ * once and used in place. The header is followed by 'count' cron_compiled
+ * expressions, 'count' entries and 'labels_size' bytes of NUL terminated
+ * labels. Images are in the byte order and layout of the build writing
+ * them: the byte order and expression size are checked when opened.
+ */
+typedef struct {
+    char magic[8]; /* CRON_IMAGE_MAGIC */
+    uint32_t version; /* CRON_IMAGE_VERSION */
+    uint32_t byte_order; /* 0x01020304 */
+    uint32_t expr_size; /* sizeof(cron_compiled) */
+    uint32_t count; /* number of expressions */
+    uint32_t labels_size;
+    uint32_t reserved; /* 0 */
+} cron_image_header;
+
+/**
+ * Flags and label of an expression in a schedule image.
+ */
+typedef struct {
+    uint32_t label; /* offset of the label */
+    uint32_t flags; /* CRON_IMAGE_NEVER */
+} cron_image_entry;
+
+/**
+ * Schedule image opened in place.
+ */
+typedef struct {
+    const cron_compiled* exprs;
+    const cron_image_entry* entries;
+    const char* labels;
+    uint32_t len; /* number of expressions */
+} cron_image;
+
+/**
+ * Writes a schedule image of the expressions, like snprintf: the image is
+ * written only if it fits in 'size' bytes.
+ *
+ * @param exprs parsed cron expressions
+ * @param labels NUL terminated label of each expression, or NULL for
+ *        empty labels
+ * @param n number of expressions
+ * @param out output image, 8 byte aligned. May be NULL if 'size' is 0.
+ * @param size size of 'out'
+ * @return size of the image, 0 if the image would be larger than 4 GB
+ */
+size_t cron_image_write(const cron_expr* exprs, const char* const* labels, size_t n, void* out, size_t size);
+
+/**
+ * Opens a schedule image without copying it, for example a file mapped
+ * with mmap(2). Every expression, flag and label is checked, so an image
+ * that was truncated, corrupted or written by another build is rejected.
+ *
+ * @param image image to initialize, pointing into 'data'
+ * @param data image, 8 byte aligned
+ * @param size size of 'data'
+ * @param error output error message, will be set to string literal
+ *        error message in case of error. Will be set to NULL on success.
+ * @return 0 on success, -1 on error
+ */
+int cron_image_open(cron_image* image, const void* data, size_t size, const char** error);
+
+/**
+ * Returns the label of an expression in an opened image.
+ *
+ * @param image opened image
+ * @param id index of the expression
+ * @return NUL terminated label, NULL if id is out of range
+ */
+const char* cron_image_label(const cron_image* image, uint32_t id);
+
+#define CRON_TABLE_MAGIC "CRONTBL"
+#define CRON_TABLE_VERSION 1
+/* fire times in a block of a table: a block is searched by decoding it */
+#define CRON_TABLE_BLOCK 32
+
+/**
+ * Header of a serialized fire time table. The header is followed by
+ * '(count + CRON_TABLE_BLOCK - 1) / CRON_TABLE_BLOCK' blocks and
+ * 'deltas_size' bytes of deltas, padded to 8 bytes. Tables are in the
+ * byte order of the build writing them.
+ */
+typedef struct {
+    char magic[8]; /* CRON_TABLE_MAGIC */
+    uint32_t version; /* CRON_TABLE_VERSION */
+    uint32_t byte_order; /* 0x01020304 */
+    int64_t from; /* horizon: fire times after 'from' */
+    int64_t to; /* and at or before 'to' */
+    uint32_t count; /* number of fire times */
+    uint32_t deltas_size;
+} cron_table_header;
+
+/**
+ * Sparse index of a fire time table: the first fire time of a block and
+ * the offset of the deltas to the following fire times of the block.
+ */
+typedef struct {
+    int64_t first;
+    uint32_t offset; /* into the deltas */
+    uint32_t reserved; /* 0 */
+} cron_table_block;
+
+/**
+ * Fire times of an expression over a horizon, stored as the first time of
+ * each block of CRON_TABLE_BLOCK times followed by the differences to the
+ * next times as unsigned LEB128 varints: usually one byte per fire time.
+ * Searching is a binary search of the blocks and decoding part of one.
+ */
+typedef struct {
+    const cron_table_header* header; /* serialized table */
+    const cron_table_block* blocks;
+    const uint8_t* deltas;
+    size_t size; /* bytes of the serialized table */
+    void* mem; /* allocated by 'cron_table_build', NULL if opened in place */
+} cron_table;
+
+/**
+ * Materializes the fire dates of the expression after 'from' and at or
+ * before 'to', as returned by 'cron_next', into a table.
+ *
+ * @param table table to initialize, freed with 'cron_table_free'
+ * @param expr parsed cron expression
+ * @param from start of the horizon, not included
+ * @param to end of the horizon, included
+ * @return 0 on success, -1 if memory could not be allocated, the table
+ *         would be larger than 4 GB or 'to' is before 'from'
+ */
+int cron_table_build(cron_table* table, const cron_expr* expr, time_t from, time_t to);
+
+/**
+ * Opens a serialized table in place, for example a file mapped with
+ * mmap(2). The table is decoded once to check it.
+ *
+ * @param table table to initialize, pointing into 'data'
+ * @param data serialized table, 8 byte aligned
+ * @param size size of 'data'
+ * @param error output error message, will be set to string literal
+ *        error message in case of error. Will be set to NULL on success.
+ * @return 0 on success, -1 on error
+ */
+int cron_table_open(cron_table* table, const void* data, size_t size, const char** error);
+
+/**
+ * Serializes a table, like snprintf: the table is written only if it fits
+ * in 'size' bytes.
+ *
+ * @param table built or opened table
+ * @param out output table. May be NULL if 'size' is 0.
+ * @param size size of 'out'
+ * @return size of the serialized table
+ */
+size_t cron_table_write(const cron_table* table, void* out, size_t size);
+
+/**
+ * Same as 'cron_next' from the table.
+ *
+ * @param table built or opened table
+ * @param date start date, in the horizon: at or after 'from' and before 'to'
+ * @return next 'fire' date, '((time_t) -1)' if the date is outside of the
+ *         horizon or there is no fire date after it in the horizon
+ */
+time_t cron_table_next(const cron_table* table, time_t date);
+
+/**
+ * Same as 'cron_prev' from the table.
+ *
+ * @param table built or opened table
+ * @param date start date, after 'from' and at or before 'to' + 1
+ * @return previous 'fire' date, '((time_t) -1)' if the date is outside of
+ *         the horizon or there is no fire date before it in the horizon
+ */
+time_t cron_table_prev(const cron_table* table, time_t date);
+
+/**
+ * Same as 'cron_count' from the table.
+ *
+ * @param table built or opened table
+ * @param from start of the range, not included, at or after the start of
+ *        the horizon
+ * @param to end of the range, included, at or before the end of the horizon
+ * @return number of fire dates, 0 if 'to' is not after 'from', -1 if the
+ *         range is outside of the horizon
+ */
+int64_t cron_table_count(const cron_table* table, time_t from, time_t to);
+
+/**
+ * Frees the memory used by a built table.
+ *
+ * @param table built or opened table
+ */
+void cron_table_free(cron_table* table);
+
+/* Local times skipped when the clock is set forward run once, at the change */
+#define CRON_DST_GAP_SHIFT 0
+/* Local times skipped when the clock is set forward do not run */
+#define CRON_DST_GAP_SKIP 1
+/* Local times repeated when the clock is set back run at the first occurrence */
+#define CRON_DST_FOLD_ONCE 0
+/* Local times repeated when the clock is set back run at both occurrences */
+#define CRON_DST_FOLD_TWICE 1
+
+/**
+ * Loads the time zone used by '-DCRON_USE_LOCAL_TIME' builds. The zone
+ * transitions are read once from the TZif file and cached: call before
+ * restricting file system access or using the library from several
+ * threads, otherwise the zone is loaded on first use. Does nothing in
+ * UTC builds.
+ *
+ * @param tz zone name, path to a TZif file or POSIX TZ string. If NULL,
+ *        the TZ environment variable or /etc/localtime is used.
+ * @return 0 on success, -1 if the zone could not be loaded and UTC is used
+ */
+int cron_tz_init(const char* tz);
+
+/**
+ * Sets how local times that are skipped or repeated by a daylight saving
+ * time change are scheduled.
+ *
+ * @param gap CRON_DST_GAP_SHIFT (default) or CRON_DST_GAP_SKIP
+ * @param fold CRON_DST_FOLD_ONCE (default) or CRON_DST_FOLD_TWICE
+ */
+void cron_set_dst_policy(int gap, int fold);
+
+#ifndef CRON_DISABLE_PARSER
+/**
+ * Sets the seed of H tokens in expressions parsed afterwards. H chooses a
+ * value of the field, H(from-to) a value of the range and H/step or
+ * H(from-to)/step the offset of the first step, derived from the seed and
+ * the field: the same seed always gives the same times, different seeds
+ * (a host or job name) spread the runs of an expression. Without a range,
+ * H chooses days 1-28 of the month and days 0-6 of the week.
+ *
+ * @param seed NUL terminated string or NULL for the empty string (default)
+ */
+void cron_set_hash_seed(const char* seed);
+#endif /* CRON_DISABLE_PARSER */
 
 
 #if defined(__cplusplus) && !defined(CRON_COMPILE_AS_CXX)
@@ -25,16 +25,42 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/random.h>
+#endif
+
 #include "ccronexpr.h"
 #include "pseudocron.h"
 
 #define PSEUDOCRON_VERSION "0.4.1"
 
 static time_t timestamp(const char *s);
+static long long number(const char *s);
 static int fields(const char *s);
 static int arg_to_timespec(const char *arg, size_t arglen, char *buf,
                            size_t buflen);
 static const char *alias_to_timespec(const char *alias);
+static long long splay_offset(const char *seed, unsigned long long entropy,
+                              long long splay);
+static void batch(time_t now);
+static void batch_record(char *line, time_t now);
+static void print_fire_times(const cron_expr *expr, time_t now,
+                             long long count, int reverse);
+static void print_missed(const cron_expr *expr, time_t since, time_t now);
+static size_t schedules(char *argv[], int argc, int opt, cron_expr **exprs,
+                        char ***labels, char **input);
+static void stream(char *argv[], int argc, time_t now, int opt,
+                   long long count, int verbose);
+static void emit_image(char *argv[], int argc, int opt);
+static int identifier(const char *s);
+static void emit_c(const char *name, const char *crontab,
+                   const cron_expr *expr);
+static void image_open(cron_image *image);
+static void histogram(char *argv[], int argc, time_t now, int opt,
+                      const char *bucket, long long count);
 static void usage(void);
 
 extern char *__progname;
@@ -55,13 +81,41 @@ static struct pseudocron_alias {
 
                           {NULL, NULL}};
 
-enum { OPT_STDIN = 1, OPT_TIMESTAMP = 2, OPT_PRINT = 4, OPT_DRYRUN = 8 };
+enum {
+  OPT_STDIN = 1,
+  OPT_TIMESTAMP = 2,
+  OPT_PRINT = 4,
+  OPT_DRYRUN = 8,
+  OPT_COUNT = 16,
+  OPT_REVERSE = 32,
+  OPT_BATCH = 64,
+  OPT_STREAM = 128,
+  OPT_SINCE = 256,
+  OPT_HISTOGRAM = 512,
+  OPT_SEED = 1024,
+  OPT_SPLAY = 2048,
+  OPT_IMAGE = 4096,
+  OPT_EMIT_IMAGE = 8192,
+  OPT_EMIT_C = 16384
+};
+
 
 static const struct option long_options[] = {
     {"stdin", no_argument, NULL, OPT_STDIN},
+    {"batch", no_argument, NULL, OPT_BATCH},
+    {"stream", no_argument, NULL, OPT_STREAM},
+    {"histogram", required_argument, NULL, OPT_HISTOGRAM},
+    {"image", no_argument, NULL, OPT_IMAGE},
+    {"emit-image", no_argument, NULL, OPT_EMIT_IMAGE},
+    {"emit-c", required_argument, NULL, OPT_EMIT_C},
     {"dryrun", no_argument, NULL, 'n'},
     {"print", no_argument, NULL, 'p'},
     {"timestamp", required_argument, NULL, OPT_TIMESTAMP},
+    {"count", required_argument, NULL, OPT_COUNT},
+    {"reverse", no_argument, NULL, OPT_REVERSE},
+    {"since", required_argument, NULL, OPT_SINCE},
+    {"seed", required_argument, NULL, OPT_SEED},
+    {"splay", required_argument, NULL, OPT_SPLAY},
     {"verbose", no_argument, NULL, 'v'},
     {"help", no_argument, NULL, 'h'},
     {NULL, 0, NULL, 0}};
@@ -71,10 +125,19 @@ int main(int argc, char *argv[]) {
   const char *errbuf = NULL;
   char buf[255] = {0};
   char arg[252] = {0};
+  char host[256] = {0};
   char *p;
   time_t now;
-  time_t next;
+  time_t next = -1;
+  time_t since = -1;
+  const char *bucket = NULL;
+  const char *seed = NULL;
+  const char *name = NULL;
   double diff;
+  long long count = 0;
+  long long splay = 0;
+  long long offset = 0;
+  unsigned long long entropy = 0;
   int opt = 0;
   int verbose = 0;
   int ch;
@@ -86,6 +149,17 @@ int main(int argc, char *argv[]) {
     err(EXIT_FAILURE, "error: time");
 
   (void)localtime(&now);
+  (void)cron_tz_init(NULL);
+
+  if (gethostname(host, sizeof(host) - 1) < 0)
+    host[0] = '\0';
+
+  /* random bytes for --splay: the sandbox does not allow getrandom(2) */
+  if (getentropy(&entropy, sizeof(entropy)) < 0)
+    entropy = (unsigned long long)now ^ (unsigned long long)getpid() << 32;
+
+  if (sleep_init() < 0)
+    err(3, "error: sleep_init");
 
   if (restrict_process_init() < 0)
     err(3, "error: restrict_process_init");
@@ -108,12 +182,69 @@ int main(int argc, char *argv[]) {
       opt |= OPT_STDIN;
       break;
 
+    case OPT_BATCH:
+      opt |= OPT_BATCH;
+      break;
+
+    case OPT_STREAM:
+      opt |= OPT_STREAM;
+      break;
+
+    case OPT_IMAGE:
+      opt |= OPT_IMAGE;
+      break;
+
+    case OPT_EMIT_IMAGE:
+      opt |= OPT_EMIT_IMAGE;
+      break;
+
+    case OPT_EMIT_C:
+      opt |= OPT_EMIT_C;
+      name = optarg;
+      if (!identifier(name))
+        errx(2, "error: invalid name: %s", optarg);
+      break;
+
+    case OPT_HISTOGRAM:
+      opt |= OPT_HISTOGRAM;
+      bucket = optarg;
+      break;
+
     case OPT_TIMESTAMP:
       now = timestamp(optarg);
       if (now == -1)
         errx(2, "error: invalid timestamp: %s", optarg);
       break;
 
+    case OPT_COUNT:
+      opt |= OPT_COUNT;
+      count = number(optarg);
+      if (count < 0)
+        errx(2, "error: invalid count: %s", optarg);
+      break;
+
+    case OPT_REVERSE:
+      opt |= OPT_REVERSE;
+      break;
+
+    case OPT_SINCE:
+      opt |= OPT_SINCE;
+      since = timestamp(optarg);
+      if (since == -1)
+        errx(2, "error: invalid timestamp: %s", optarg);
+      break;
+
+    case OPT_SEED:
+      seed = optarg;
+      break;
+
+    case OPT_SPLAY:
+      opt |= OPT_SPLAY;
+      splay = number(optarg);
+      if (splay < 0 || splay > UINT32_MAX)
+        errx(2, "error: invalid splay: %s", optarg);
+      break;
+
     case 'h':
       usage();
       exit(0);
@@ -126,6 +257,60 @@ int main(int argc, char *argv[]) {
   argc -= optind;
   argv += optind;
 
+  /* the offset delays the run of a single crontab, not the listed times */
+  if ((opt & OPT_SPLAY) &&
+      (opt & (OPT_COUNT | OPT_SINCE | OPT_BATCH | OPT_STREAM | OPT_HISTOGRAM |
+              OPT_IMAGE | OPT_EMIT_IMAGE | OPT_EMIT_C))) {
+    usage();
+    exit(2);
+  }
+
+  /* H in expressions is derived from the seed, by default the host name */
+  if (seed == NULL)
+    seed = getenv("PSEUDOCRON_SEED");
+  cron_set_hash_seed(seed == NULL ? host : seed);
+
+  if (opt & OPT_SPLAY)
+    offset = splay_offset(seed, entropy, splay);
+
+  if (opt & OPT_BATCH) {
+    if (argc != 0) {
+      usage();
+      exit(2);
+    }
+    batch(now);
+    return 0;
+  }
+
+  if (opt & OPT_EMIT_IMAGE) {
+    emit_image(argv, argc, opt);
+    return 0;
+  }
+
+  if ((opt & OPT_IMAGE) && argc != 0) {
+    usage();
+    exit(2);
+  }
+
+  if (opt & OPT_STREAM) {
+    stream(argv, argc, now, opt, count, verbose);
+    return 0;
+  }
+
+  if (opt & OPT_IMAGE) {
+    cron_image image;
+
+    /* verify the image: output the number of schedules */
+    image_open(&image);
+    (void)printf("%lu\n", (unsigned long)image.len);
+    return 0;
+  }
+
+  if (opt & OPT_HISTOGRAM) {
+    histogram(argv, argc, now, opt, bucket, count);
+    return 0;
+  }
+
   switch (argc) {
   case 0: {
     char *nl = NULL;
@@ -168,6 +353,17 @@ int main(int argc, char *argv[]) {
 
   if ((strcmp(buf, "@never") == 0) ||
       (strcmp(arg, "@reboot") == 0 && getenv("PSEUDOCRON_REBOOT"))) {
+    if (opt & OPT_EMIT_C) {
+      /* no bits set: never matches */
+      emit_c(name, buf, &expr);
+      return 0;
+    }
+    if (opt & OPT_COUNT)
+      return 0;
+    if (opt & OPT_SINCE) {
+      (void)printf("0\t-1\n");
+      return 0;
+    }
     diff = UINT32_MAX;
     goto PSEUDOCRON_SLEEP;
   }
@@ -176,11 +372,31 @@ int main(int argc, char *argv[]) {
   if (errbuf)
     errx(EXIT_FAILURE, "error: invalid crontab timespec: %s", errbuf);
 
+  if (opt & OPT_EMIT_C) {
+    emit_c(name, buf, &expr);
+    return 0;
+  }
+
+  if (opt & OPT_SINCE) {
+    print_missed(&expr, since, now);
+    return 0;
+  }
+
+  if (opt & OPT_COUNT) {
+    print_fire_times(&expr, now, count, opt & OPT_REVERSE);
+    return 0;
+  }
+
   next = cron_next(&expr, now);
   if (next == -1)
     errx(EXIT_FAILURE, "error: cron_next: next scheduled interval: %s",
          errno == 0 ? "invalid timespec" : strerror(errno));
 
+  next += offset;
+
+  if (verbose > 1 && (opt & OPT_SPLAY))
+    (void)fprintf(stderr, "splay=%lld\n", offset);
+
   if (verbose > 0) {
     (void)fprintf(stderr, "now[%lld]=%s", (long long)now, ctime(&now));
     (void)fprintf(stderr, "next[%lld]=%s", (long long)next, ctime(&next));
@@ -195,9 +411,37 @@ PSEUDOCRON_SLEEP:
     (void)printf("%.f\n", diff);
 
   if (!(opt & OPT_DRYRUN)) {
-    unsigned int sleepfor = diff > UINT32_MAX ? UINT32_MAX : (unsigned int)diff;
-    while (sleepfor > 0)
-      sleepfor = sleep(sleepfor);
+    if (next == -1) {
+      unsigned int sleepfor =
+          diff > UINT32_MAX ? UINT32_MAX : (unsigned int)diff;
+      while (sleepfor > 0)
+        sleepfor = sleep(sleepfor);
+    } else {
+      while ((rv = sleep_until(next)) == 1) {
+        /* the system clock was set: run if the time has passed */
+        now = time(NULL);
+        if (now == -1)
+          err(EXIT_FAILURE, "error: time");
+
+        if (now >= next)
+          break;
+
+        /* the first run after now, delayed by the same offset */
+        next = cron_next(&expr, now - offset);
+        if (next == -1)
+          errx(EXIT_FAILURE, "error: cron_next: next scheduled interval: %s",
+               errno == 0 ? "invalid timespec" : strerror(errno));
+
+        next += offset;
+
+        if (verbose > 0)
+          (void)fprintf(stderr, "next[%lld]=%s", (long long)next,
+                        ctime(&next));
+      }
+
+      if (rv < 0)
+        err(EXIT_FAILURE, "error: sleep_until");
+    }
   }
 
   if (verbose > 1) {
@@ -260,6 +504,610 @@ static int arg_to_timespec(const char *arg, size_t arglen, char *buf,
   return (rv < 0 || (unsigned)rv >= buflen) ? -1 : 0;
 }
 
+/* offset of less than splay seconds: random or, with a seed, the same
+ * for each run */
+static long long splay_offset(const char *seed, unsigned long long entropy,
+                              long long splay) {
+  unsigned long long h = entropy;
+
+  if (splay == 0)
+    return 0;
+
+  if (seed != NULL) {
+    /* FNV-1a */
+    h = 0xcbf29ce484222325ULL;
+    for (; *seed != '\0'; seed++) {
+      h ^= (unsigned char)*seed;
+      h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 32;
+  }
+
+  return (long long)(h % (unsigned long long)splay);
+}
+
+/* read expression[<TAB>timestamp] lines until EOF */
+static void batch(time_t now) {
+  static char in[65536];
+  static char out[65536];
+  size_t len = 0;
+  ssize_t n;
+  char *line;
+  char *nl;
+  int skip = 0;
+
+  if (setvbuf(stdout, out, _IOFBF, sizeof(out)) != 0)
+    err(EXIT_FAILURE, "error: setvbuf");
+
+  for (;;) {
+    n = read(STDIN_FILENO, in + len, sizeof(in) - 1 - len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      err(EXIT_FAILURE, "error: read failure");
+    }
+
+    if (n == 0)
+      break;
+
+    len += (size_t)n;
+
+    for (line = in; (nl = memchr(line, '\n', len - (size_t)(line - in)));
+         line = nl + 1) {
+      *nl = '\0';
+      if (skip)
+        skip = 0;
+      else
+        batch_record(line, now);
+    }
+
+    len -= (size_t)(line - in);
+    (void)memmove(in, line, len);
+
+    /* discard the rest of a line longer than the buffer */
+    if (len == sizeof(in) - 1) {
+      if (!skip)
+        (void)printf("-1\t0\trecord exceeds maximum length: %zu\n",
+                     sizeof(in) - 1);
+      skip = 1;
+      len = 0;
+    }
+  }
+
+  if (len > 0 && !skip) {
+    in[len] = '\0';
+    batch_record(in, now);
+  }
+
+  if (fflush(stdout) == EOF)
+    err(EXIT_FAILURE, "error: write");
+}
+
+/* output the next time or -1, the column and the reason for an error */
+static void batch_record(char *line, time_t now) {
+  cron_expr expr = {0};
+  const char *errbuf = NULL;
+  char buf[255] = {0};
+  char arg[252] = {0};
+  char *p;
+  char *tab;
+  time_t next;
+  int offset = -1;
+  int rv;
+
+  p = strchr(line, '\r');
+  if (p != NULL)
+    *p = '\0';
+
+  tab = strrchr(line, '\t');
+  if (tab != NULL) {
+    *tab = '\0';
+    /* epoch seconds do not need a round trip through local time */
+    next = tab[1] == '@' ? (time_t)number(tab + 2) : timestamp(tab + 1);
+    if (next == -1) {
+      (void)printf("-1\t%d\tinvalid timestamp\n", (int)(tab - line) + 2);
+      return;
+    }
+    now = next;
+  }
+
+  rv = snprintf(arg, sizeof(arg), "%s", line);
+  if (rv < 0 || (unsigned)rv >= sizeof(arg)) {
+    (void)printf("-1\t0\ttimespec exceeds maximum length: %zu\n",
+                 sizeof(arg));
+    return;
+  }
+
+  for (p = arg; *p != '\0'; p++)
+    if (*p == '\t')
+      *p = ' ';
+
+  if (arg_to_timespec(arg, sizeof(arg), buf, sizeof(buf)) < 0) {
+    (void)printf("-1\t1\tinvalid crontab timespec\n");
+    return;
+  }
+
+  if ((strcmp(buf, "@never") == 0) ||
+      (strcmp(arg, "@reboot") == 0 && getenv("PSEUDOCRON_REBOOT"))) {
+    (void)printf("-1\t0\tnever scheduled\n");
+    return;
+  }
+
+  cron_parse_expr_offset(buf, &expr, &errbuf, &offset);
+  if (errbuf) {
+    /* 5 field expressions are prefixed with "0 " */
+    if (fields(arg) == 5)
+      offset -= 2;
+    (void)printf("-1\t%d\t%s\n", offset < 0 ? 1 : offset + 1, errbuf);
+    return;
+  }
+
+  next = cron_next(&expr, now);
+  if (next == -1) {
+    (void)printf("-1\t0\tinvalid timespec\n");
+    return;
+  }
+
+  (void)printf("%lld\n", (long long)next);
+}
+
+static char *read_all(int fd, size_t *lenp) {
+  char *buf = NULL;
+  char *p;
+  size_t size = 0;
+  size_t len = 0;
+  ssize_t n;
+
+  for (;;) {
+    if (size - len < 2) {
+      size = size == 0 ? 4096 : size * 2;
+      p = realloc(buf, size);
+      if (p == NULL)
+        err(EXIT_FAILURE, "error: realloc");
+      buf = p;
+    }
+
+    n = read(fd, buf + len, size - len - 1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      err(EXIT_FAILURE, "error: read failure");
+    }
+
+    if (n == 0)
+      break;
+
+    len += (size_t)n;
+  }
+
+  buf[len] = '\0';
+  if (lenp != NULL)
+    *lenp = len;
+  return buf;
+}
+
+/* parse [LABEL=]crontab, returning the label */
+static char *schedule_init(char *item, cron_expr *expr) {
+  const char *errbuf = NULL;
+  char buf[255] = {0};
+  char arg[252] = {0};
+  char *spec = item;
+  char *eq;
+  char *p;
+  int rv;
+
+  for (p = item; *p != '\0'; p++)
+    if (*p == '\t' || *p == '\r')
+      *p = ' ';
+
+  eq = strchr(item, '=');
+  if (eq != NULL) {
+    *eq = '\0';
+    spec = eq + 1;
+  }
+
+  rv = snprintf(arg, sizeof(arg), "%s", spec);
+  if (rv < 0 || (unsigned)rv >= sizeof(arg))
+    errx(EXIT_FAILURE, "error: %s: timespec exceeds maximum length: %zu",
+         item, sizeof(arg));
+
+  if (arg_to_timespec(arg, sizeof(arg), buf, sizeof(buf)) < 0)
+    errx(EXIT_FAILURE, "error: %s: invalid crontab timespec", item);
+
+  if ((strcmp(buf, "@never") == 0) ||
+      (strcmp(arg, "@reboot") == 0 && getenv("PSEUDOCRON_REBOOT"))) {
+    /* no bits set: never matches */
+    (void)memset(expr, 0, sizeof(*expr));
+    return item;
+  }
+
+  cron_parse_expr(buf, expr, &errbuf);
+  if (errbuf)
+    errx(EXIT_FAILURE, "error: %s: invalid crontab timespec: %s", item,
+         errbuf);
+
+  return item;
+}
+
+/* parse [LABEL=]crontab arguments, then stdin lines with --stdin */
+static size_t schedules(char *argv[], int argc, int opt, cron_expr **exprs,
+                        char ***labels, char **input) {
+  size_t n = 0;
+  size_t i;
+  char *line;
+  char *nl;
+
+  *input = NULL;
+  if (opt & OPT_STDIN) {
+    *input = read_all(STDIN_FILENO, NULL);
+    for (line = *input; *line != '\0'; line = nl + 1) {
+      nl = strchr(line, '\n');
+      if (line[0] != '\n')
+        n++;
+      if (nl == NULL)
+        break;
+    }
+  }
+
+  n += (size_t)argc;
+  if (n == 0) {
+    usage();
+    exit(2);
+  }
+
+  *exprs = calloc(n, sizeof(**exprs));
+  if (*exprs == NULL)
+    err(EXIT_FAILURE, "error: calloc");
+
+  *labels = calloc(n, sizeof(**labels));
+  if (*labels == NULL)
+    err(EXIT_FAILURE, "error: calloc");
+
+  for (i = 0; i < (size_t)argc; i++)
+    (*labels)[i] = schedule_init(argv[i], &(*exprs)[i]);
+
+  if (*input != NULL) {
+    for (line = *input; i < n; line = nl + 1) {
+      nl = strchr(line, '\n');
+      if (nl != NULL)
+        *nl = '\0';
+      if (line[0] == '\0')
+        continue;
+
+      (*labels)[i] = schedule_init(line, &(*exprs)[i]);
+      i++;
+    }
+  }
+
+  return n;
+}
+
+/* output label<TAB>time each time a schedule runs */
+static void stream(char *argv[], int argc, time_t now, int opt,
+                   long long count, int verbose) {
+  static char out[65536];
+  cron_sched sched;
+  cron_image image = {0};
+  cron_expr *exprs = NULL;
+  char **labels = NULL;
+  char *input = NULL;
+  const char *label;
+  size_t n;
+  size_t i;
+  time_t next;
+  time_t fire;
+  uint32_t id;
+  int rv;
+
+  if (setvbuf(stdout, out, _IOFBF, sizeof(out)) != 0)
+    err(EXIT_FAILURE, "error: setvbuf");
+
+  if (opt & OPT_IMAGE) {
+    /* the expressions are used in place: nothing is parsed */
+    image_open(&image);
+    if (cron_sched_load(&sched, image.exprs, image.len, now) < 0)
+      err(EXIT_FAILURE, "error: cron_sched_load");
+  } else {
+    n = schedules(argv, argc, opt, &exprs, &labels, &input);
+
+    cron_sched_init(&sched);
+
+    /* schedule ids are numbered in the order added */
+    for (i = 0; i < n; i++)
+      if (cron_sched_add(&sched, &exprs[i], now) < 0)
+        err(EXIT_FAILURE, "error: cron_sched_add");
+  }
+
+  while ((next = cron_sched_next(&sched)) != -1 &&
+         (!(opt & OPT_COUNT) || count > 0)) {
+    if (verbose > 0)
+      (void)fprintf(stderr, "next[%lld]=%s", (long long)next, ctime(&next));
+
+    if (!(opt & OPT_DRYRUN)) {
+      if (fflush(stdout) == EOF)
+        err(EXIT_FAILURE, "error: write");
+
+      rv = sleep_until(next);
+      if (rv < 0)
+        err(EXIT_FAILURE, "error: sleep_until");
+
+      now = time(NULL);
+      if (now == -1)
+        err(EXIT_FAILURE, "error: time");
+
+      if (rv == 1 && now < next) {
+        /* the system clock was set back: calculate every schedule again */
+        cron_sched_reset(&sched, now);
+        continue;
+      }
+
+      /* times missed while the process was stopped run once */
+      if (now > next)
+        next = now;
+    }
+
+    while ((!(opt & OPT_COUNT) || count > 0) &&
+           cron_sched_pop(&sched, next, &id, &fire)) {
+      label = (opt & OPT_IMAGE) ? cron_image_label(&image, id) : labels[id];
+      if (printf("%s\t%lld\n", label, (long long)fire) < 0)
+        err(EXIT_FAILURE, "error: write");
+      if (opt & OPT_COUNT)
+        count--;
+    }
+  }
+
+  if (next == -1 && !(opt & OPT_COUNT) && !(opt & OPT_DRYRUN)) {
+    /* nothing left to run */
+    if (fflush(stdout) == EOF)
+      err(EXIT_FAILURE, "error: write");
+    for (;;)
+      (void)sleep(UINT32_MAX);
+  }
+
+  if (fflush(stdout) == EOF)
+    err(EXIT_FAILURE, "error: write");
+
+  cron_sched_free(&sched);
+  free(exprs);
+  free(labels);
+  free(input);
+}
+
+/* write the schedule image of [LABEL=]crontab arguments (or stdin lines) */
+static void emit_image(char *argv[], int argc, int opt) {
+  cron_expr *exprs;
+  char **labels;
+  char *input;
+  void *image;
+  size_t size;
+  size_t n;
+
+  n = schedules(argv, argc, opt, &exprs, &labels, &input);
+
+  size = cron_image_write(exprs, (const char *const *)labels, n, NULL, 0);
+  if (size == 0)
+    errx(EXIT_FAILURE, "error: cron_image_write: image exceeds 4 GB");
+
+  /* malloc(3) memory is aligned for the image */
+  image = malloc(size);
+  if (image == NULL)
+    err(EXIT_FAILURE, "error: malloc");
+
+  (void)cron_image_write(exprs, (const char *const *)labels, n, image, size);
+
+  if (fwrite(image, 1, size, stdout) != size || fflush(stdout) == EOF)
+    err(EXIT_FAILURE, "error: write");
+
+  free(image);
+  free(exprs);
+  free(labels);
+  free(input);
+}
+
+/* C identifier: [A-Za-z_][A-Za-z0-9_]* */
+static int identifier(const char *s) {
+  const char *p;
+
+  if (*s == '\0' || (*s >= '0' && *s <= '9'))
+    return 0;
+
+  for (p = s; *p != '\0'; p++)
+    if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+          (*p >= '0' && *p <= '9') || *p == '_'))
+      return 0;
+
+  return 1;
+}
+
+static void emit_bytes(const uint8_t *bytes, size_t len, const char *field,
+                       int last) {
+  size_t i;
+
+  (void)printf("    {");
+  for (i = 0; i < len; i++)
+    (void)printf("%s0x%02x", i == 0 ? "" : ", ", bytes[i]);
+  (void)printf("}%s /* %s */\n", last ? "" : ",", field);
+}
+
+/* output C initializers of the parsed and the compiled expression */
+static void emit_c(const char *name, const char *crontab,
+                   const cron_expr *expr) {
+  cron_compiled compiled;
+  const char *p;
+
+  cron_compile(expr, &compiled);
+
+  /* the crontab may contain the end of a comment */
+  (void)printf("/* ");
+  for (p = crontab; *p != '\0'; p++)
+    (void)printf(*p == '/' && (p[1] == '*' || (p > crontab && p[-1] == '*'))
+                     ? "\\/"
+                     : "%c",
+                 *p);
+  (void)printf(" */\n");
+  (void)printf(
+      "/* with -DCRON_USE_LOCAL_TIME, call cron_tz_init() at startup:\n"
+      " * the zone is otherwise read, allocating, at the first use */\n");
+
+  (void)printf("static const cron_expr %s = {\n", name);
+  emit_bytes(expr->seconds, sizeof(expr->seconds), "seconds", 0);
+  emit_bytes(expr->minutes, sizeof(expr->minutes), "minutes", 0);
+  emit_bytes(expr->hours, sizeof(expr->hours), "hours", 0);
+  emit_bytes(expr->days_of_week, sizeof(expr->days_of_week), "days of week",
+             0);
+  emit_bytes(expr->days_of_month, sizeof(expr->days_of_month),
+             "days of month", 0);
+  emit_bytes(expr->months, sizeof(expr->months), "months", 1);
+  (void)printf("};\n\n");
+
+  (void)printf("static const cron_compiled %s_compiled = {\n", name);
+  (void)printf("    UINT64_C(0x%llx), /* seconds */\n",
+               (unsigned long long)compiled.seconds);
+  (void)printf("    UINT64_C(0x%llx), /* minutes */\n",
+               (unsigned long long)compiled.minutes);
+  (void)printf("    0x%lxU, /* hours */\n", (unsigned long)compiled.hours);
+  (void)printf("    0x%lxU, /* days of month */\n",
+               (unsigned long)compiled.days_of_month);
+  (void)printf("    0x%xU, /* months */\n", (unsigned)compiled.months);
+  (void)printf("    0x%xU, /* days of week */\n",
+               (unsigned)compiled.days_of_week);
+  (void)printf("    %luU, /* period */\n", (unsigned long)compiled.period);
+  (void)printf("    %luU /* phase */\n", (unsigned long)compiled.phase);
+  (void)printf("};\n");
+
+  if (fflush(stdout) == EOF)
+    err(EXIT_FAILURE, "error: write");
+}
+
+/* map the schedule image on stdin, reading it if stdin is not a file */
+static void image_open(cron_image *image) {
+  const char *errbuf = NULL;
+  struct stat st;
+  void *data = MAP_FAILED;
+  size_t size = 0;
+
+  if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size > 0 && (unsigned long long)st.st_size <= SIZE_MAX) {
+    size = (size_t)st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+  }
+
+  if (data == MAP_FAILED)
+    data = read_all(STDIN_FILENO, &size);
+
+  if (cron_image_open(image, data, size, &errbuf) < 0)
+    errx(EXIT_FAILURE, "error: invalid image: %s", errbuf);
+}
+
+/* output the start of each bucket (epoch) and the number of runs in it */
+static void histogram(char *argv[], int argc, time_t now, int opt,
+                      const char *bucket, long long count) {
+  static char out[65536];
+  cron_expr *exprs;
+  char **labels;
+  char *input;
+  int64_t *counts;
+  time_t size;
+  size_t n;
+  long long i;
+
+  if (strcmp(bucket, "second") == 0)
+    size = 1;
+  else if (strcmp(bucket, "minute") == 0)
+    size = 60;
+  else if (strcmp(bucket, "hour") == 0)
+    size = 3600;
+  else if ((size = (time_t)number(bucket)) <= 0)
+    errx(2, "error: invalid bucket: %s", bucket);
+
+  if (!(opt & OPT_COUNT))
+    count = 60;
+
+  if (setvbuf(stdout, out, _IOFBF, sizeof(out)) != 0)
+    err(EXIT_FAILURE, "error: setvbuf");
+
+  n = schedules(argv, argc, opt, &exprs, &labels, &input);
+
+  counts = calloc(count > 0 ? (size_t)count : 1, sizeof(*counts));
+  if (counts == NULL)
+    err(EXIT_FAILURE, "error: calloc");
+
+  /* buckets start on a multiple of the bucket size */
+  now -= (now % size + size) % size;
+
+  if (cron_histogram(exprs, n, now, size, (size_t)count, counts) < 0)
+    errx(EXIT_FAILURE, "error: cron_histogram: invalid range");
+
+  for (i = 0; i < count; i++)
+    if (printf("%lld\t%lld\n", (long long)(now + i * size),
+               (long long)counts[i]) < 0)
+      err(EXIT_FAILURE, "error: write");
+
+  if (fflush(stdout) == EOF)
+    err(EXIT_FAILURE, "error: write");
+
+  free(counts);
+  free(exprs);
+  free(labels);
+  free(input);
+}
+
+static void print_fire_times(const cron_expr *expr, time_t now,
+                             long long count, int reverse) {
+  static char buf[65536];
+  cron_iter iter;
+  time_t t;
+
+  if (setvbuf(stdout, buf, _IOFBF, sizeof(buf)) != 0)
+    err(EXIT_FAILURE, "error: setvbuf");
+
+  cron_iter_init(&iter, expr, now);
+
+  for (; count > 0; count--) {
+    t = reverse ? cron_iter_prev(&iter) : cron_iter_next(&iter);
+    if (t == -1) {
+      (void)fflush(stdout);
+      errx(EXIT_FAILURE, "error: %s: scheduled interval: %s",
+           reverse ? "cron_prev" : "cron_next",
+           errno == 0 ? "invalid timespec" : strerror(errno));
+    }
+
+    if (printf("%lld\n", (long long)t) < 0)
+      err(EXIT_FAILURE, "error: write");
+  }
+
+  if (fflush(stdout) == EOF)
+    err(EXIT_FAILURE, "error: write");
+}
+
+/* output the number of runs after since up to now and the last run at or
+ * before now */
+static void print_missed(const cron_expr *expr, time_t since, time_t now) {
+  int64_t missed;
+  time_t last;
+
+  missed = cron_count(expr, since, now);
+  if (missed < 0)
+    errx(EXIT_FAILURE, "error: cron_count: invalid range");
+
+  last = cron_prev(expr, now + 1);
+
+  if (printf("%lld\t%lld\n", (long long)missed, (long long)last) < 0)
+    err(EXIT_FAILURE, "error: write");
+}
+
+static long long number(const char *s) {
+  char *end = NULL;
+  long long n;
+
+  errno = 0;
+  n = strtoll(s, &end, 10);
+  if (errno != 0 || end == s || *end != '\0' || n < 0)
+    return -1;
+
+  return n;
+}
+
 static time_t timestamp(const char *s) {
   struct tm tm = {0};
 
@@ -303,6 +1151,32 @@ static void usage() {
                 "-v, --verbose          verbose mode\n"
                 "    --timestamp <YY-MM-DD hh-mm-ss|@epoch>\n"
                 "                       provide an initial time\n"
-                "    --stdin            read crontab from stdin\n",
+                "    --count <n>        output the next n times (epoch)\n"
+                "    --reverse          with --count, output previous times\n"
+                "    --since <YY-MM-DD hh-mm-ss|@epoch>\n"
+                "                       output the number of runs since the\n"
+                "                       time and the last run (epoch)\n"
+                "    --seed <string>    seed of H in crontabs (default:\n"
+                "                       $PSEUDOCRON_SEED or the host name)\n"
+                "    --splay <seconds>  delay runs by a random offset (or\n"
+                "                       derived from the seed) of less than\n"
+                "                       seconds\n"
+                "    --stdin            read crontab from stdin\n"
+                "    --batch            output the next time (epoch) for each\n"
+                "                       crontab[<TAB>timestamp] line of stdin\n"
+                "    --stream           run [LABEL=]crontab arguments (or stdin\n"
+                "                       lines), output LABEL<TAB>epoch per run\n"
+                "    --emit-image       write the schedule image of [LABEL=]crontab\n"
+                "                       arguments (or stdin lines) to stdout\n"
+                "    --image            read a schedule image from stdin for\n"
+                "                       --stream or output the number of\n"
+                "                       schedules\n"
+                "    --emit-c <name>    output C initializers of the crontab\n"
+                "                       as cron_expr name and cron_compiled\n"
+                "                       name_compiled\n"
+                "    --histogram <second|minute|hour|seconds>\n"
+                "                       output epoch<TAB>runs of all crontab\n"
+                "                       arguments (or stdin lines) for --count\n"
+                "                       buckets (default: 60)\n",
                 __progname, PSEUDOCRON_VERSION, RESTRICT_PROCESS);
 }
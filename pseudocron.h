@@ -14,4 +14,9 @@
  * limitations under the License.
  */
 
+#include <time.h>
+
 int restrict_process_init(void);
+
+int sleep_init(void);
+int sleep_until(time_t t);
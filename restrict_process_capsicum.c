@@ -31,7 +31,8 @@ int restrict_process_init(void) {
   if (setrlimit(RLIMIT_NPROC, &rl) < 0)
     return -1;
 
-  (void)cap_rights_init(&policy_read, CAP_READ);
+  /* --image maps stdin */
+  (void)cap_rights_init(&policy_read, CAP_READ, CAP_FSTAT, CAP_MMAP_R);
   (void)cap_rights_init(&policy_write, CAP_WRITE, CAP_FSTAT);
 
   if (cap_rights_limit(STDIN_FILENO, &policy_read) < 0)
@@ -95,6 +95,18 @@ int restrict_process_init(void) {
 #ifdef __NR_nanosleep
       SC_ALLOW(nanosleep),
 #endif
+#ifdef __NR_clock_nanosleep
+      SC_ALLOW(clock_nanosleep),
+#endif
+#ifdef __NR_clock_nanosleep_time64
+      SC_ALLOW(clock_nanosleep_time64),
+#endif
+#ifdef __NR_timerfd_settime
+      SC_ALLOW(timerfd_settime),
+#endif
+#ifdef __NR_timerfd_settime64
+      SC_ALLOW(timerfd_settime64),
+#endif
 #ifdef __NR_clock_getres
       SC_ALLOW(clock_getres),
 #endif
@@ -0,0 +1,70 @@
+/* Copyright 2018-2025 Michael Santos <michael.santos@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* clock_nanosleep(2): defined before any header includes <time.h> */
+#ifdef SLEEP_clock_nanosleep
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "pseudocron.h"
+#ifdef SLEEP_clock_nanosleep
+#include <errno.h>
+#include <time.h>
+
+int sleep_init(void) { return 0; }
+
+/* wake at the start of the second, restarting after signals */
+int sleep_until(time_t t) {
+  struct timespec deadline = {0};
+  int rv;
+
+  deadline.tv_sec = t;
+
+#ifdef TIMER_ABSTIME
+  while ((rv = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &deadline,
+                               NULL)) == EINTR)
+    ;
+
+  if (rv != 0) {
+    errno = rv;
+    return -1;
+  }
+#else
+  /* no clock_nanosleep: sleep for the time remaining to the deadline */
+  for (;;) {
+    struct timespec now;
+    struct timespec remaining;
+
+    if (clock_gettime(CLOCK_REALTIME, &now) < 0)
+      return -1;
+
+    if (now.tv_sec >= deadline.tv_sec)
+      break;
+
+    remaining.tv_sec = deadline.tv_sec - now.tv_sec - 1;
+    remaining.tv_nsec = 1000000000L - now.tv_nsec;
+    if (remaining.tv_nsec == 1000000000L) {
+      remaining.tv_sec++;
+      remaining.tv_nsec = 0;
+    }
+
+    rv = nanosleep(&remaining, NULL);
+    if (rv < 0 && errno != EINTR)
+      return -1;
+  }
+#endif
+
+  return 0;
+}
+#endif
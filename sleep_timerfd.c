@@ -0,0 +1,57 @@
+/* Copyright 2018-2025 Michael Santos <michael.santos@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "pseudocron.h"
+#ifdef SLEEP_timerfd
+#include <errno.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static int timerfd = -1;
+
+/* the descriptor is opened before the process is restricted */
+int sleep_init(void) {
+  timerfd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+  return timerfd < 0 ? -1 : 0;
+}
+
+/* the timer is cancelled if the system clock is set, for example by NTP
+ * or after a suspend */
+int sleep_until(time_t t) {
+  struct itimerspec deadline = {0};
+  uint64_t expirations;
+  ssize_t n;
+
+  deadline.it_value.tv_sec = t;
+
+  if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                      &deadline, NULL) < 0)
+    return errno == ECANCELED ? 1 : -1;
+
+  for (;;) {
+    n = read(timerfd, &expirations, sizeof(expirations));
+    if (n == sizeof(expirations))
+      return 0;
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n < 0 && errno == ECANCELED)
+      return 1;
+
+    return -1;
+  }
+}
+#endif
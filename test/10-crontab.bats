@@ -148,3 +148,336 @@ EOF
   [ "$status" -eq 0 ]
   [ "$output" -eq 4294967295 ]
 }
+
+@test "timestamp: daylight savings: skipped local time runs at the change" {
+  run env TZ=America/New_York pseudocron -np --timestamp "@1520751300" "15 2 * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" -eq 300 ]
+}
+
+@test "timestamp: daylight savings: repeated local time runs once" {
+  run env TZ=America/New_York pseudocron -np --timestamp "@1541310900" "15 1 * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" -eq 87600 ]
+}
+
+@test "count: next fire times" {
+  run env TZ=UTC pseudocron --count 3 --timestamp "@1520751300" "*/15 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1520751600\n1520752500\n1520753400')" ]
+}
+
+@test "count: previous fire times" {
+  run env TZ=America/New_York pseudocron --count 2 --reverse --timestamp "@1520751300" "15 2 * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1520666100\n1520579700')" ]
+}
+
+@test "count: invalid count" {
+  run pseudocron --count foo "* * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 2 ]
+  [ "$output" = "pseudocron: error: invalid count: foo" ]
+}
+
+@test "batch: next time for each line" {
+  run /bin/sh -c 'printf "*/15 * * * *\t@1520751300\n0 */5 * 26 * *\t2018-01-24 18:18:18\n" | env TZ=UTC pseudocron --batch'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1520751600\n1516924800')" ]
+}
+
+@test "batch: errors report the column" {
+  run /bin/sh -c 'printf "* 61 * * *\n@foo\n" | pseudocron --batch'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf -- '-1\t3\tSpecified range exceeds maximum\n-1\t1\tinvalid crontab timespec')" ]
+}
+
+@test "batch: invalid timestamp" {
+  run /bin/sh -c 'printf "0 0 * * *\t3\n0 0 * * *\t@1700000000x\n" | pseudocron --batch'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf -- '-1\t11\tinvalid timestamp\n-1\t11\tinvalid timestamp')" ]
+}
+
+@test "stream: labeled schedules in order" {
+  run env TZ=UTC pseudocron --stream -n --count 5 --timestamp "@1520751300" "q=*/15 * * * *" "0 */20 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf 'q\t1520751600\n0 */20 * * * *\t1520751600\nq\t1520752500\n0 */20 * * * *\t1520752800\nq\t1520753400')" ]
+}
+
+@test "stream: schedules from stdin" {
+  run /bin/sh -c 'printf "a=*/15 * * * *\n\nb=@hourly\n" | env TZ=UTC pseudocron --stream --stdin -n --count 3 --timestamp "@1520751300"'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf 'a\t1520751600\nb\t1520751600\na\t1520752500')" ]
+}
+
+@test "stream: invalid schedule" {
+  run pseudocron --stream "x=* 61 * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 1 ]
+  [ "$output" = "pseudocron: error: x: invalid crontab timespec: Specified range exceeds maximum" ]
+}
+
+@test "since: seconds in 5 years" {
+  run env TZ=UTC pseudocron --since @1500000000 --timestamp @1657680000 "* * * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '157680000\t1657680000')" ]
+}
+
+@test "since: runs skipped by daylight saving time run once" {
+  run env TZ=America/New_York pseudocron --since "2018-03-10 00:00:00" --timestamp "2018-03-13 00:00:00" "30 2 * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '3\t1520836200')" ]
+}
+
+@test "since: never" {
+  run pseudocron --since @1500000000 @never
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '0\t-1')" ]
+}
+
+@test "histogram: runs per hour" {
+  run /bin/sh -c 'printf "0 * * * *\n*/15 * * * *\n0 0 * * *\n" | env TZ=UTC pseudocron --histogram hour --count 3 --stdin --timestamp @1700000000 "x=@hourly"'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1699999200\t6\n1700002800\t6\n1700006400\t7')" ]
+}
+
+@test "histogram: runs skipped by daylight saving time run once" {
+  run env TZ=America/New_York pseudocron --histogram 1800 --count 4 --timestamp @1520749800 "30 2 * * *" "*/20 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1520749800\t1\n1520751600\t3\n1520753400\t1\n1520755200\t2')" ]
+}
+
+@test "histogram: invalid bucket" {
+  run pseudocron --histogram fortnight "* * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 2 ]
+  [ "$output" = "pseudocron: error: invalid bucket: fortnight" ]
+}
+
+@test "H: same seed gives the same minute" {
+  run env TZ=UTC PSEUDOCRON_SEED=web-1 pseudocron --count 2 --timestamp @1700000000 "H * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(env TZ=UTC pseudocron --seed web-1 --count 2 --timestamp @1700000000 'H * * * *')" ]
+  [ "$output" = "$(printf '1700000940\n1700004540')" ]
+}
+
+@test "H: different seeds spread runs" {
+  run env TZ=UTC pseudocron --seed web-2 --count 2 --timestamp @1700000000 "H * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1700000460\n1700004060')" ]
+}
+
+@test "H: step starts at an offset within the step" {
+  run env TZ=UTC pseudocron --seed web-1 --count 5 --timestamp @1700000000 "H/15 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1700000040\n1700000940\n1700001840\n1700002740\n1700003640')" ]
+}
+
+@test "H: range" {
+  run env TZ=UTC pseudocron --seed web-1 --count 2 --timestamp @1700000000 "H(0-29) H(2-5) * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '1700022540\n1700108940')" ]
+}
+
+@test "H: invalid range" {
+  run pseudocron --seed web-1 -n "H-5 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 1 ]
+  [ "$output" = "pseudocron: error: invalid crontab timespec: Hash must be H or H(from-to)" ]
+}
+
+@test "splay: seeded offset" {
+  run pseudocron -n -p --seed web-1 --splay 600 --timestamp @1700000000 "0 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "2953" ]
+}
+
+@test "splay: random offset is less than the splay" {
+  run pseudocron -n -p --splay 600 --timestamp @1700000000 "0 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" -ge 2800 ]
+  [ "$output" -lt 3400 ]
+}
+
+@test "splay: invalid splay" {
+  run pseudocron -n --splay 1s "* * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 2 ]
+  [ "$output" = "pseudocron: error: invalid splay: 1s" ]
+}
+
+@test "splay: rejected when listing times" {
+  run pseudocron --splay 60 --count 3 "* * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 2 ]
+}
+
+@test "splay: rejected when streaming" {
+  run pseudocron --splay 60 --stream -n --count 1 "* * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 2 ]
+}
+
+@test "crontab format: day of month never in the months" {
+  run pseudocron -n "0 0 31 4,6 *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 1 ]
+  [ "$output" = "pseudocron: error: invalid crontab timespec: Day of month never occurs in the months specified" ]
+}
+
+@test "crontab format: leap day on a day of week" {
+  run env TZ=UTC pseudocron --count 3 --timestamp @1700000000 "0 0 29 2 1"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf '2340316800\n3223929600\n4486147200')" ]
+}
+
+@test "image: stream schedules mapped from a file" {
+  run bash -c 'pseudocron --emit-image "a=*/20 * * * *" "b=0 0 * * *" > "$BATS_TMPDIR/pseudocron.image" && TZ=UTC pseudocron --image --stream -n --count 4 --timestamp @1699919999 < "$BATS_TMPDIR/pseudocron.image"'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "$(printf 'a\t1699920000\nb\t1699920000\na\t1699921200\na\t1699922400')" ]
+}
+
+@test "image: verify the number of schedules" {
+  run bash -c 'printf "0 0 * * *\nweekly=@weekly\nnever=@never\n" | pseudocron --emit-image --stdin | pseudocron --image'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "$output" = "3" ]
+}
+
+@test "image: invalid image" {
+  run bash -c 'echo "*/5 * * * *" | pseudocron --image'
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 1 ]
+  [ "$output" = "pseudocron: error: invalid image: Not a schedule image" ]
+}
+
+@test "emit-c: compiled in without the parser" {
+  pseudocron --emit-c every --seed test "H/20 H 1-7 * mon" > "$BATS_TMPDIR/every.h"
+  cat << 'EOF' > "$BATS_TMPDIR/every.c"
+#include <stdio.h>
+#include "ccronexpr.h"
+#include "every.h"
+
+int main(void) {
+  (void)printf("%lld\n%lld\n", (long long)cron_next(&every, 1700000000),
+               (long long)cron_next_compiled(&every_compiled, 1700000000));
+  return 0;
+}
+EOF
+  ${CC:-cc} -DCRON_DISABLE_PARSER -DCRON_USE_LOCAL_TIME -I. -I"$BATS_TMPDIR" \
+    -o "$BATS_TMPDIR/every" "$BATS_TMPDIR/every.c" ccronexpr.c
+  run env TZ=UTC "$BATS_TMPDIR/every"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "${lines[0]}" = "$(TZ=UTC pseudocron --seed test --count 1 --timestamp @1700000000 "H/20 H 1-7 * mon")" ]
+  [ "${lines[1]}" = "${lines[0]}" ]
+}
+
+@test "emit-c: comment end in the crontab" {
+  run pseudocron --emit-c every5 "*/5 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+  [ "${lines[0]}" = "/* 0 *\/5 * * * * */" ]
+  [ "${lines[1]}" = "/* with -DCRON_USE_LOCAL_TIME, call cron_tz_init() at startup:" ]
+  [ "${lines[3]}" = "static const cron_expr every5 = {" ]
+  [[ "$output" == *"    300U, /* period */"* ]]
+}
+
+@test "emit-c: invalid name" {
+  run pseudocron --emit-c 5min "*/5 * * * *"
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 2 ]
+  [ "$output" = "pseudocron: error: invalid name: 5min" ]
+}
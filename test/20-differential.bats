@@ -0,0 +1,49 @@
+#!/usr/bin/env bats
+
+@test "differential: UTC" {
+  run test/differential_utc -n 20000
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+}
+
+@test "differential: America/New_York" {
+  run env TZ=America/New_York test/differential_local -n 3000
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+}
+
+@test "differential: America/New_York: skip, twice" {
+  run env TZ=America/New_York test/differential_local -n 3000 -g skip -f twice
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+}
+
+@test "differential: Europe/London" {
+  run env TZ=Europe/London test/differential_local -n 3000 -s 2
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+}
+
+@test "differential: Australia/Lord_Howe: 30 minute changes" {
+  run env TZ=Australia/Lord_Howe test/differential_local -n 3000 -s 3 -g skip
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+}
+
+@test "differential: America/Sao_Paulo: changes at midnight" {
+  run env TZ=America/Sao_Paulo test/differential_local -n 3000 -s 4 -f twice
+cat << EOF
+$output
+EOF
+  [ "$status" -eq 0 ]
+}
@@ -0,0 +1,700 @@
+/*
+ * Copyright 2018-2023 Michael Santos <michael.santos@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares cron_next, cron_prev, cron_iter, cron_match, cron_index and
+ * cron_histogram with a naive oracle over random expressions and start
+ * times, and schedule images and fire time tables with cron_next.
+ *
+ * The oracle walks time using the C library to convert to local time,
+ * skipping the rest of a day, hour or minute that does not match, and
+ * stops at each change of UTC offset to apply the daylight saving time
+ * policy.
+ */
+#define _DEFAULT_SOURCE
+#include <err.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ccronexpr.h"
+
+/* the oracle gives up after about 3 years */
+#define HORIZON (3 * 366 * 86400L)
+
+/* iterator steps compared after each start time */
+#define STEPS 4
+
+/* expressions and times compared using an index */
+#define INDEXED 128
+
+/* seconds around each start time compared using cron_match_batch */
+#define WINDOW 192
+
+/* buckets compared using cron_histogram */
+#define HISTOGRAM 90
+
+/* seconds around each start time in a fire time table */
+#define TABLE (4 * 3600)
+
+/* start dates compared using a fire time table */
+#define TABLE_DATES 32
+
+static int gap = CRON_DST_GAP_SHIFT;
+static int fold = CRON_DST_FOLD_ONCE;
+
+static long local(time_t t, struct tm *tm) {
+#ifdef CRON_USE_LOCAL_TIME
+  if (localtime_r(&t, tm) == NULL)
+    errx(EXIT_FAILURE, "error: localtime_r: %lld", (long long)t);
+  return tm->tm_gmtoff;
+#else
+  if (gmtime_r(&t, tm) == NULL)
+    errx(EXIT_FAILURE, "error: gmtime_r: %lld", (long long)t);
+  return 0;
+#endif
+}
+
+static long offset(time_t t) {
+  struct tm tm;
+  return local(t, &tm);
+}
+
+static int bit(const uint8_t *bits, int n) { return (bits[n / 8] >> (n % 8)) & 1; }
+
+static int match_date(const cron_expr *expr, const struct tm *tm) {
+  return bit(expr->months, tm->tm_mon) &&
+         bit(expr->days_of_month, tm->tm_mday) &&
+         bit(expr->days_of_week, tm->tm_wday);
+}
+
+static int match(const cron_expr *expr, time_t t) {
+  struct tm tm;
+
+  (void)local(t, &tm);
+  return match_date(expr, &tm) && bit(expr->hours, tm.tm_hour) &&
+         bit(expr->minutes, tm.tm_min) && bit(expr->seconds, tm.tm_sec);
+}
+
+/* a local time skipped when the clock went forward at t matches */
+static int skipped(const cron_expr *expr, time_t t, long before, long after) {
+  struct tm tm;
+  time_t w;
+
+  for (w = t + before; w < t + after; w++) {
+    if (gmtime_r(&w, &tm) == NULL)
+      errx(EXIT_FAILURE, "error: gmtime_r: %lld", (long long)w);
+
+    if (match_date(expr, &tm) && bit(expr->hours, tm.tm_hour) &&
+        bit(expr->minutes, tm.tm_min) && bit(expr->seconds, tm.tm_sec))
+      return 1;
+  }
+
+  return 0;
+}
+
+/* the local time at t already happened before the clock went back */
+static int repeated(time_t t, long off) {
+  long before = offset(t - 3 * 3600);
+  return before > off && offset(t - (before - off)) == before;
+}
+
+/* seconds from t to the next local day, hour, minute or second that may
+ * match, or 0 if t matches */
+static long mismatch(const cron_expr *expr, time_t t, long off,
+                     const struct tm *tm, int forward) {
+  long sod = tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec;
+
+  if (!match_date(expr, tm))
+    return forward ? 86400 - sod : sod + 1;
+  if (!bit(expr->hours, tm->tm_hour))
+    return forward ? 3600 - sod % 3600 : sod % 3600 + 1;
+  if (!bit(expr->minutes, tm->tm_min))
+    return forward ? 60 - tm->tm_sec : tm->tm_sec + 1;
+  if (!bit(expr->seconds, tm->tm_sec))
+    return 1;
+  if (fold == CRON_DST_FOLD_ONCE && repeated(t, off))
+    return 1;
+  return 0;
+}
+
+static time_t oracle_next(const cron_expr *expr, time_t from) {
+  struct tm tm;
+  time_t t = from + 1;
+  time_t lo, hi, mid;
+  long off, after, jump;
+
+  /* the search starts at a change of UTC offset */
+  off = offset(from);
+  after = offset(t);
+  if (after > off && gap == CRON_DST_GAP_SHIFT && skipped(expr, t, off, after))
+    return t;
+
+  while (t <= from + HORIZON) {
+    off = local(t, &tm);
+    jump = mismatch(expr, t, off, &tm, 1);
+    if (jump == 0)
+      return t;
+
+    if (offset(t + jump) == off) {
+      t += jump;
+      continue;
+    }
+
+    /* first instant with the new offset */
+    for (lo = t, hi = t + jump; hi - lo > 1;) {
+      mid = lo + (hi - lo) / 2;
+      if (offset(mid) == off)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    after = offset(hi);
+    if (after > off && gap == CRON_DST_GAP_SHIFT && hi <= from + HORIZON &&
+        skipped(expr, hi, off, after))
+      return hi;
+
+    t = hi;
+  }
+
+  return -1;
+}
+
+static time_t oracle_prev(const cron_expr *expr, time_t from) {
+  struct tm tm;
+  time_t t = from - 1;
+  time_t lo, hi, mid;
+  long off, before, jump;
+
+  while (t >= from - HORIZON) {
+    off = local(t, &tm);
+    jump = mismatch(expr, t, off, &tm, 0);
+    if (jump == 0)
+      return t;
+
+    if (offset(t - jump) == off) {
+      t -= jump;
+      continue;
+    }
+
+    /* first instant with the current offset */
+    for (lo = t - jump, hi = t; hi - lo > 1;) {
+      mid = lo + (hi - lo) / 2;
+      if (offset(mid) == off)
+        hi = mid;
+      else
+        lo = mid;
+    }
+
+    before = offset(lo);
+    if (off > before && gap == CRON_DST_GAP_SHIFT &&
+        skipped(expr, hi, before, off))
+      return hi;
+
+    t = lo;
+  }
+
+  return -1;
+}
+
+/* results past the horizon of the oracle are not checked */
+static int agree(time_t want, time_t got, time_t from, int forward) {
+  if (want == got)
+    return 1;
+  if (want != -1)
+    return 0;
+  return got == -1 || (forward ? got > from + HORIZON : got < from - HORIZON);
+}
+
+static const char *field(char *buf, size_t len, int lo, int hi) {
+  int a = lo + rand() % (hi - lo + 1);
+  int b = lo + rand() % (hi - lo + 1);
+
+  if (a > b) {
+    int t = a;
+    a = b;
+    b = t;
+  }
+
+  switch (rand() % 7) {
+  case 0:
+    (void)snprintf(buf, len, "*");
+    break;
+  case 1:
+  case 2:
+    (void)snprintf(buf, len, "%d", a);
+    break;
+  case 3:
+    (void)snprintf(buf, len, "%d-%d", a, b);
+    break;
+  case 4:
+    (void)snprintf(buf, len, "*/%d", 1 + rand() % (hi - lo + 1));
+    break;
+  case 5:
+    (void)snprintf(buf, len, "%d,%d", a, b);
+    break;
+  default:
+    (void)snprintf(buf, len, "%d-%d/%d", a, b, 1 + rand() % 5);
+    break;
+  }
+
+  return buf;
+}
+
+/* every day at times a constant period apart */
+static void periodic(char *buf, size_t len) {
+  static const int minutes[] = {1, 2, 3, 4, 5, 6, 10, 12, 15, 20, 30, 60};
+  static const int hours[] = {1, 2, 3, 4, 6, 8, 12, 24};
+  int m = minutes[rand() % 12];
+  int h = hours[rand() % 8];
+
+  switch (rand() % 3) {
+  case 0:
+    (void)snprintf(buf, len, "%d/%d * * * * *", rand() % m, m);
+    break;
+  case 1:
+    (void)snprintf(buf, len, "%d %d/%d * * * *", rand() % 60, rand() % m, m);
+    break;
+  default:
+    (void)snprintf(buf, len, "%d %d %d/%d * * *", rand() % 60, rand() % 60,
+                   rand() % h, h);
+    break;
+  }
+}
+
+/* a day of month on a day of week, leap days running every 28 years or so */
+static void rare(char *buf, size_t len) {
+  if (rand() % 2)
+    (void)snprintf(buf, len, "0 %d %d 29 2 %d", rand() % 60, rand() % 4,
+                   rand() % 7);
+  else
+    (void)snprintf(buf, len, "0 0 %d %d %d %d", rand() % 24, 28 + rand() % 4,
+                   1 + rand() % 12, rand() % 7);
+}
+
+static void expression(char *buf, size_t len) {
+  char f[6][16];
+
+  if (rand() % 4 == 0) {
+    periodic(buf, len);
+    return;
+  }
+
+  if (rand() % 16 == 0) {
+    rare(buf, len);
+    return;
+  }
+
+  (void)snprintf(
+      buf, len, "%s %s %s %s %s %s",
+      rand() % 2 ? "0" : field(f[0], sizeof(f[0]), 0, 59),
+      field(f[1], sizeof(f[1]), 0, 59),
+      /* local times around daylight saving time changes */
+      rand() % 3 ? field(f[2], sizeof(f[2]), 0, 3)
+                 : field(f[2], sizeof(f[2]), 0, 23),
+      rand() % 2 ? "*"
+                 : (rand() % 3 ? field(f[3], sizeof(f[3]), 1, 31)
+                               : field(f[3], sizeof(f[3]), 28, 31)),
+      rand() % 2 ? "*" : field(f[4], sizeof(f[4]), 1, 12),
+      rand() % 2 ? "*" : field(f[5], sizeof(f[5]), 0, 6));
+}
+
+/* 1990 to 2042, half of them within hours of a change of UTC offset */
+static time_t start(void) {
+  time_t t = 631152000 + (time_t)(rand() % 1670000000);
+  time_t lo, hi, mid;
+  long off;
+  int i;
+
+  if (rand() % 2)
+    return t;
+
+  off = offset(t);
+  for (i = 0; i < 400; i++, t += 86400) {
+    if (offset(t + 86400) == off)
+      continue;
+
+    for (lo = t, hi = t + 86400; hi - lo > 1;) {
+      mid = lo + (hi - lo) / 2;
+      if (offset(mid) == off)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    /* the second before the change or the hours around it */
+    return rand() % 4 ? hi - 4 * 3600 + rand() % (8 * 3600) : hi - 1;
+  }
+
+  return t;
+}
+
+/* each second around the start time runs if the next run after the
+ * previous second is at it */
+static int check_match(const cron_expr *expr, const char *text, time_t from) {
+  time_t dates[WINDOW];
+  uint64_t out[(WINDOW + 63) / 64];
+  int64_t count;
+  int failed = 0;
+  int want, got;
+  int i;
+
+  for (i = 0; i < WINDOW; i++)
+    dates[i] = from - WINDOW / 2 + i;
+
+  count = cron_match_batch(expr, dates, WINDOW, out);
+  if (cron_count(expr, dates[0] - 1, dates[WINDOW - 1]) != count) {
+    (void)printf("count\t\"%s\"\t@%lld\twant=%lld\tgot=%lld\n", text,
+                 (long long)dates[0] - 1, (long long)count,
+                 (long long)cron_count(expr, dates[0] - 1, dates[WINDOW - 1]));
+    failed++;
+  }
+  for (i = 0; i < WINDOW && failed < 10; i++) {
+    want = cron_next(expr, dates[i] - 1) == dates[i];
+    got = (out[i / 64] >> (i % 64)) & 1;
+    count -= got;
+    if (want != got || cron_match(expr, dates[i]) != want) {
+      (void)printf("match\t\"%s\"\t@%lld\twant=%d\tgot=%d,%d\n", text,
+                   (long long)dates[i], want, got, cron_match(expr, dates[i]));
+      failed++;
+    }
+  }
+  if (count != 0) {
+    (void)printf("match\t\"%s\"\t@%lld\tcount off by %lld\n", text,
+                 (long long)from, (long long)count);
+    failed++;
+  }
+
+  return failed;
+}
+
+/* the runs in each bucket are the sum of the runs of each expression */
+static int check_histogram(const cron_expr *exprs, int n, time_t from,
+                           time_t bucket, size_t buckets) {
+  int64_t counts[HISTOGRAM];
+  int64_t want;
+  int failed = 0;
+  size_t k;
+  int id;
+
+  if (cron_histogram(exprs, (size_t)n, from, bucket, buckets, counts) != 0)
+    errx(EXIT_FAILURE, "error: cron_histogram");
+
+  for (k = 0; k < buckets && failed < 10; k++) {
+    for (want = 0, id = 0; id < n; id++)
+      want += cron_count(&exprs[id], from + (time_t)k * bucket - 1,
+                         from + (time_t)(k + 1) * bucket - 1);
+    if (want != counts[k]) {
+      (void)printf("histogram\t@%lld\t%lld\twant=%lld\tgot=%lld\n",
+                   (long long)(from + (time_t)k * bucket), (long long)bucket,
+                   (long long)want, (long long)counts[k]);
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+/* every expression is matched at every time */
+static int check_index(const cron_expr *exprs, char (*text)[128],
+                       const time_t *times, int n) {
+  cron_index index;
+  uint64_t out[(INDEXED + 63) / 64];
+  int64_t count;
+  int failed = 0;
+  int want, got;
+  int i, id;
+
+  cron_index_init(&index);
+  for (id = 0; id < n; id++)
+    if (cron_index_add(&index, &exprs[id]) != id)
+      errx(EXIT_FAILURE, "error: cron_index_add");
+
+  for (i = 0; i < n && failed < 10; i++) {
+    count = cron_index_match(&index, times[i], out);
+    for (id = 0; id < n; id++) {
+      want = match(&exprs[id], times[i]);
+      got = (out[id / 64] >> (id % 64)) & 1;
+      count -= got;
+      if (want != got) {
+        (void)printf("index\t\"%s\"\t@%lld\twant=%d\tgot=%d\n", text[id],
+                     (long long)times[i], want, got);
+        failed++;
+      }
+    }
+    if (count != 0) {
+      (void)printf("index\t@%lld\tcount off by %lld\n", (long long)times[i],
+                   (long long)count);
+      failed++;
+    }
+  }
+
+  cron_index_free(&index);
+  return failed;
+}
+
+/* a table answers like cron_next, cron_prev and cron_count in the horizon,
+ * before and after a round trip through its serialized form */
+static int check_table(const cron_expr *expr, const char *text, time_t from) {
+  cron_table built;
+  cron_table opened;
+  const cron_table *table;
+  const char *errbuf = NULL;
+  void *data;
+  size_t size;
+  time_t lo = from - TABLE;
+  time_t hi = from + TABLE;
+  time_t d, want, got;
+  int64_t wantc, gotc;
+  int failed = 0;
+  int k;
+
+  if (cron_table_build(&built, expr, lo, hi) != 0)
+    errx(EXIT_FAILURE, "error: cron_table_build");
+
+  size = cron_table_write(&built, NULL, 0);
+  data = malloc(size);
+  if (data == NULL)
+    err(EXIT_FAILURE, "error: malloc");
+  if (cron_table_write(&built, data, size) != size ||
+      cron_table_open(&opened, data, size, &errbuf) != 0)
+    errx(EXIT_FAILURE, "error: cron_table_open: %s", errbuf);
+
+  for (k = 0; k < 2 * TABLE_DATES && failed < 10; k++) {
+    table = k % 2 ? &opened : &built;
+    /* the last date is the end of the horizon */
+    d = k == 2 * TABLE_DATES - 1 ? hi
+                                 : lo + (time_t)(((long)k * 7919) % (2 * TABLE));
+
+    want = cron_next(expr, d);
+    if (want > hi)
+      want = -1;
+    got = cron_table_next(table, d);
+    if (want != got) {
+      (void)printf("table_next\t\"%s\"\t@%lld\twant=%lld\tgot=%lld\n", text,
+                   (long long)d, (long long)want, (long long)got);
+      failed++;
+    }
+
+    want = cron_prev(expr, d + 1);
+    if (want <= lo)
+      want = -1;
+    got = cron_table_prev(table, d + 1);
+    if (want != got) {
+      (void)printf("table_prev\t\"%s\"\t@%lld\twant=%lld\tgot=%lld\n", text,
+                   (long long)d + 1, (long long)want, (long long)got);
+      failed++;
+    }
+
+    wantc = cron_count(expr, d, hi);
+    gotc = cron_table_count(table, d, hi);
+    if (wantc != gotc || cron_table_count(table, lo, d) !=
+                             cron_table_count(table, lo, hi) - gotc) {
+      (void)printf("table_count\t\"%s\"\t@%lld\twant=%lld\tgot=%lld\n",
+                   text, (long long)d, (long long)wantc, (long long)gotc);
+      failed++;
+    }
+  }
+
+  if (cron_table_next(&built, lo - 1) != -1 ||
+      cron_table_next(&built, hi) != -1 || cron_table_prev(&built, lo) != -1 ||
+      cron_table_count(&built, lo - 1, hi) != -1) {
+    (void)printf("table\t\"%s\"\t@%lld\toutside of the horizon\n", text,
+                 (long long)from);
+    failed++;
+  }
+
+  cron_table_free(&built);
+  free(data);
+  return failed;
+}
+
+/* an image of the expressions runs them at the same times as parsed */
+static int check_image(const cron_expr *exprs, char (*text)[128],
+                       const time_t *times, int n) {
+  static uint64_t data[(sizeof(cron_image_header) +
+                        INDEXED * (sizeof(cron_compiled) +
+                                   sizeof(cron_image_entry) + 128)) /
+                           8 +
+                       1];
+  const char *labels[INDEXED];
+  const char *errbuf = NULL;
+  cron_image image;
+  size_t size;
+  time_t want, got;
+  int failed = 0;
+  int id;
+
+  for (id = 0; id < n; id++)
+    labels[id] = text[id];
+
+  size = cron_image_write(exprs, labels, (size_t)n, data, sizeof(data));
+  if (size == 0 || size > sizeof(data))
+    errx(EXIT_FAILURE, "error: cron_image_write: %zu", size);
+  if (cron_image_open(&image, data, size, &errbuf) != 0)
+    errx(EXIT_FAILURE, "error: cron_image_open: %s", errbuf);
+  if (cron_image_open(&image, data, size - 8, &errbuf) == 0)
+    errx(EXIT_FAILURE, "error: cron_image_open: truncated image opened");
+  (void)cron_image_open(&image, data, size, &errbuf);
+
+  for (id = 0; id < n && failed < 10; id++) {
+    want = cron_next(&exprs[id], times[id]);
+    got = cron_next_compiled(&image.exprs[id], times[id]);
+    if (want != got || strcmp(cron_image_label(&image, id), text[id]) != 0) {
+      (void)printf("image\t\"%s\"\t@%lld\twant=%lld\tgot=%lld\t\"%s\"\n",
+                   text[id], (long long)times[id], (long long)want,
+                   (long long)got, cron_image_label(&image, id));
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+static void usage(const char *name) {
+  (void)fprintf(stderr,
+                "usage: %s [-n <cases>] [-s <seed>] [-g shift|skip] "
+                "[-f once|twice]\n",
+                name);
+}
+
+int main(int argc, char *argv[]) {
+  cron_expr expr;
+  cron_iter iter;
+  cron_expr indexed[INDEXED];
+  char text[INDEXED][128];
+  time_t times[INDEXED];
+  int n = 0;
+  const char *errbuf = NULL;
+  char buf[128];
+  time_t from, t, want, got;
+  long cases = 1000;
+  long seed = 1;
+  long i;
+  int failed = 0;
+  int forward;
+  int k;
+  int ch;
+
+  while ((ch = getopt(argc, argv, "f:g:hn:s:")) != -1) {
+    switch (ch) {
+    case 'f':
+      if (strcmp(optarg, "once") == 0)
+        fold = CRON_DST_FOLD_ONCE;
+      else if (strcmp(optarg, "twice") == 0)
+        fold = CRON_DST_FOLD_TWICE;
+      else
+        errx(2, "error: invalid fold policy: %s", optarg);
+      break;
+    case 'g':
+      if (strcmp(optarg, "shift") == 0)
+        gap = CRON_DST_GAP_SHIFT;
+      else if (strcmp(optarg, "skip") == 0)
+        gap = CRON_DST_GAP_SKIP;
+      else
+        errx(2, "error: invalid gap policy: %s", optarg);
+      break;
+    case 'n':
+      cases = strtol(optarg, NULL, 10);
+      break;
+    case 's':
+      seed = strtol(optarg, NULL, 10);
+      break;
+    case 'h':
+      usage(argv[0]);
+      exit(0);
+    default:
+      usage(argv[0]);
+      exit(2);
+    }
+  }
+
+  tzset();
+  if (cron_tz_init(NULL) < 0)
+    errx(EXIT_FAILURE, "error: cron_tz_init");
+  cron_set_dst_policy(gap, fold);
+  srand((unsigned)seed);
+
+  for (i = 0; i < cases && failed < 10; i++) {
+    expression(buf, sizeof(buf));
+    cron_parse_expr(buf, &expr, &errbuf);
+    if (errbuf)
+      continue;
+
+    from = start();
+
+    failed += check_match(&expr, buf, from);
+    failed += check_table(&expr, buf, from);
+
+    /* fire times match their own expression, start times rarely do */
+    indexed[n] = expr;
+    (void)snprintf(text[n], sizeof(text[n]), "%s", buf);
+    times[n] = n % 2 ? from : cron_next(&expr, from);
+    if (++n == INDEXED) {
+      failed += check_index(indexed, text, times, n);
+      failed += check_image(indexed, text, times, n);
+      /* minutes, unaligned minutes, seconds and hours around a change */
+      t = from - from % 60 - 45 * 60;
+      failed += check_histogram(indexed, n, t, 60, HISTOGRAM);
+      failed += check_histogram(indexed, n, t + 7, 60, HISTOGRAM);
+      failed += check_histogram(indexed, n, from - HISTOGRAM / 2, 1, HISTOGRAM);
+      failed += check_histogram(indexed, n, t - t % 3600 - 12 * 3600, 3600, 30);
+      n = 0;
+    }
+
+    for (forward = 1; forward >= 0; forward--) {
+      got = forward ? cron_next(&expr, from) : cron_prev(&expr, from);
+      want = forward ? oracle_next(&expr, from) : oracle_prev(&expr, from);
+      if (!agree(want, got, from, forward)) {
+        (void)printf("%s\t\"%s\"\t@%lld\twant=%lld\tgot=%lld\n",
+                     forward ? "next" : "prev", buf, (long long)from,
+                     (long long)want, (long long)got);
+        failed++;
+        continue;
+      }
+
+      cron_iter_init(&iter, &expr, from);
+      for (k = 0, t = from; k < STEPS && t != -1; k++) {
+        got = forward ? cron_iter_next(&iter) : cron_iter_prev(&iter);
+        want = forward ? oracle_next(&expr, t) : oracle_prev(&expr, t);
+        if (!agree(want, got, t, forward)) {
+          (void)printf("iter_%s\t\"%s\"\t@%lld\twant=%lld\tgot=%lld\n",
+                       forward ? "next" : "prev", buf, (long long)t,
+                       (long long)want, (long long)got);
+          failed++;
+          break;
+        }
+        if (got != -1 && (forward ? cron_count(&expr, from, got)
+                                  : cron_count(&expr, got - 1, from - 1)) !=
+                             k + 1) {
+          (void)printf("count_%s\t\"%s\"\t@%lld\t@%lld\twant=%d\n",
+                       forward ? "next" : "prev", buf, (long long)from,
+                       (long long)got, k + 1);
+          failed++;
+          break;
+        }
+        t = got;
+      }
+    }
+  }
+
+  (void)printf("%ld cases, %d failures (seed %ld)\n", i, failed, seed);
+
+  return failed == 0 ? 0 : 1;
+}